@@ -127,6 +127,21 @@ file_write_at (struct file *file, const void *buffer, off_t size,
   return inode_write_at (file->inode, buffer, size, file_ofs);
 }
 
+/* Reserves disk space for the LENGTH bytes of FILE starting at
+   offset OFFSET, extending the file to OFFSET + LENGTH bytes if
+   it is shorter than that.  Newly reserved bytes read as zeros.
+   Returns true if successful, false if the space could not be
+   allocated or writes to FILE are denied.
+   The file's current position is unaffected. */
+bool
+file_allocate (struct file *file, off_t offset, off_t length)
+{
+  ASSERT (file != NULL);
+  if (inode_get_status (file->inode))
+    return false;
+  return inode_allocate (file->inode, offset, length);
+}
+
 /* Prevents write operations on FILE's underlying inode
    until file_allow_write() is called or FILE is closed. */
 void
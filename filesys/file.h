@@ -2,6 +2,7 @@
 //19981
 #define FILESYS_FILE_H
 
+#include <stdbool.h>
 #include "filesys/off_t.h"
 
 struct inode;
@@ -18,6 +19,9 @@ off_t file_read_at (struct file *, void *, off_t size, off_t start);
 off_t file_write (struct file *, const void *, off_t);
 off_t file_write_at (struct file *, const void *, off_t size, off_t start);
 
+/* Preallocating space. */
+bool file_allocate (struct file *, off_t offset, off_t length);
+
 /* Preventing writes. */
 void file_deny_write (struct file *);
 void file_allow_write (struct file *);
@@ -438,7 +438,48 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
   return bytes_read;
 }
 
-bool inode_grow (off_t size, off_t offset, struct inode_disk *id)
+/* A run of consecutive free-map sectors reserved up front, from
+   which inode_grow() takes data sectors before falling back to
+   allocating them one at a time.  Sectors allocated outside the
+   run, data and index alike, are noted in TAKEN, so that they
+   can be given back if growing fails. */
+struct sector_run
+  {
+    block_sector_t next;                /* Next unused sector of the run. */
+    size_t left;                        /* Sectors remaining in the run. */
+    block_sector_t *taken;              /* Sectors allocated outside the run. */
+    size_t taken_cnt;                   /* Number of sectors in TAKEN. */
+  };
+
+/* Allocates one index sector into *SECTORP, never from RUN, and
+   notes it in RUN if RUN is non-null. */
+static bool
+grow_allocate_index (struct sector_run *run, block_sector_t *sectorp)
+{
+  if (!free_map_allocate (1, sectorp))
+    return false;
+  if (run != NULL)
+    run->taken[run->taken_cnt++] = *sectorp;
+  return true;
+}
+
+/* Allocates one data sector into *SECTORP, taking it from RUN if
+   RUN is non-null and not yet used up. */
+static bool
+grow_allocate (struct sector_run *run, block_sector_t *sectorp)
+{
+  if (run != NULL && run->left > 0)
+    {
+      *sectorp = run->next++;
+      run->left--;
+      return true;
+    }
+  return grow_allocate_index (run, sectorp);
+}
+
+static bool
+inode_grow (off_t size, off_t offset, struct inode_disk *id,
+            struct sector_run *run)
 {
   int i,j,k;
   size_t start_sec = bytes_to_sectors(id->length);
@@ -454,7 +495,7 @@ bool inode_grow (off_t size, off_t offset, struct inode_disk *id)
 
   for (i=start_sec; i < (int)end_sec && i < N_DIRECT; i++)
   {
-    if (free_map_allocate (1, &id->start[i])) 
+    if (grow_allocate (run, &id->start[i]))
     {
       cache_write(id->start[i], zeros, BLOCK_SECTOR_SIZE, 0);
       if (i == (int)end_sec -1) success = true;
@@ -465,10 +506,9 @@ bool inode_grow (off_t size, off_t offset, struct inode_disk *id)
   {
     j=0;
 
-    if (i == N_DIRECT)
-    {
-      free_map_allocate (1, &id->start[INDEX_IN_DIRECT]);
-    }
+    if (i == N_DIRECT
+        && !grow_allocate_index (run, &id->start[INDEX_IN_DIRECT]))
+      return false;
     
     uint32_t *temp = malloc(BLOCK_SECTOR_SIZE);
     if (start_sec > N_DIRECT)
@@ -479,7 +519,7 @@ bool inode_grow (off_t size, off_t offset, struct inode_disk *id)
 
     for (; i < (int)end_sec && i < N_IN_DIRECT + N_DIRECT; i++)
     {
-      if (free_map_allocate (1, (temp + j)))
+      if (grow_allocate (run, (temp + j)))
       {
         cache_write(*(block_sector_t *)(temp + j), zeros, BLOCK_SECTOR_SIZE, 0);
         if (i == (int)end_sec -1) success = true; 
@@ -489,7 +529,8 @@ bool inode_grow (off_t size, off_t offset, struct inode_disk *id)
     cache_write(id->start[INDEX_IN_DIRECT], temp, BLOCK_SECTOR_SIZE, 0);
     free(temp);
   }
-  if (i < (int)end_sec && free_map_allocate (1, &id->start[INDEX_DOUBLY_DIRECT]))
+  if (i < (int)end_sec
+      && grow_allocate_index (run, &id->start[INDEX_DOUBLY_DIRECT]))
   {
     j=0;
     k=0;
@@ -498,11 +539,11 @@ bool inode_grow (off_t size, off_t offset, struct inode_disk *id)
 
     for (j=0; j < N_IN_DIRECT && i < (int)end_sec && i < N_IN_DIRECT+N_DIRECT+N_DOUBLY_DIRECT; j++)
     {
-      if (free_map_allocate (1,(temp1+j)))
+      if (grow_allocate_index (run, (temp1+j)))
       {
         for (k=0; k < N_IN_DIRECT && i<(int)end_sec && i < N_IN_DIRECT+N_DIRECT+N_DOUBLY_DIRECT; k++,i++)
         {
-          if (free_map_allocate (1, (temp2 + k)))
+          if (grow_allocate (run, (temp2 + k)))
           {
             cache_write(*(block_sector_t *)(temp2 + k), zeros, BLOCK_SECTOR_SIZE, 0);
             if (i == (int)end_sec -1) success = true; 
@@ -542,7 +583,7 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
 
   if ( (size + offset) > id->length)
   {
-    if(!inode_grow (size, offset, id))
+    if(!inode_grow (size, offset, id, NULL))
     {
       free (id);
       return 0;
@@ -578,6 +619,79 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
   return bytes_written;
 }
 
+/* Reserves disk space for LENGTH bytes of INODE starting at
+   OFFSET, growing INODE to OFFSET + LENGTH bytes if it is
+   shorter.  The new data sectors are taken from a single
+   contiguous run of the free map when one is available, so that
+   later sequential writes into the reserved range neither
+   allocate nor seek; otherwise they are allocated one at a time
+   as inode_write_at() would.  If allocation fails partway, every
+   sector taken is given back and INODE is left as it was.
+   Returns true if successful, false if writes are denied or disk
+   allocation fails. */
+bool
+inode_allocate (struct inode *inode, off_t offset, off_t length)
+{
+  struct sector_run run;
+  bool success = true;
+
+  ASSERT (offset >= 0 && length >= 0);
+
+  if (inode->deny_write_cnt)
+    return false;
+
+  struct inode_disk *id = malloc(sizeof(struct inode_disk));
+  if (id == NULL)
+    return false;
+  cache_read(inode->sector, id, BLOCK_SECTOR_SIZE, 0);
+
+  if (offset + length > id->length)
+  {
+    size_t start_sec = bytes_to_sectors (id->length);
+    size_t end_sec = bytes_to_sectors (offset + length);
+    block_sector_t run_start = 0;
+    size_t run_cnt = 0, k;
+
+    // room for every sector that may come from outside the run:
+    // all data sectors and the index sectors over them
+    run.taken = malloc ((end_sec - start_sec + N_IN_DIRECT + 2)
+                        * sizeof *run.taken);
+    if (run.taken == NULL)
+      {
+        free (id);
+        return false;
+      }
+    run.taken_cnt = 0;
+    run.left = 0;
+    if (end_sec > start_sec && free_map_allocate (end_sec - start_sec, &run.next))
+      {
+        run_start = run.next;
+        run_cnt = run.left = end_sec - start_sec;
+      }
+
+    success = inode_grow (length, offset, id, &run);
+
+    if (success)
+      {
+        // give back whatever part of the run was not used
+        if (run.left > 0)
+          free_map_release (run.next, run.left);
+        cache_write(inode->sector, id, BLOCK_SECTOR_SIZE, 0);
+      }
+    else
+      {
+        // the on-disk inode was not changed: give back all of it
+        if (run_cnt > 0)
+          free_map_release (run_start, run_cnt);
+        for (k = 0; k < run.taken_cnt; k++)
+          free_map_release (run.taken[k], 1);
+      }
+    free (run.taken);
+  }
+  free (id);
+  return success;
+}
+
 /* Disables writes to INODE.
    May be called at most once per inode opener. */
 void
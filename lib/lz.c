@@ -0,0 +1,117 @@
+#include <lz.h>
+#include <stdint.h>
+
+/* A back-reference is two bytes: the match length less
+   MATCH_MIN in the top MATCH_BITS bits and the distance back in
+   the remaining 10 bits. */
+#define MATCH_BITS 6
+#define MATCH_MIN 3
+#define MATCH_MAX ((1 << MATCH_BITS) + (MATCH_MIN - 1))
+#define OFFSET_MASK ((1 << (16 - MATCH_BITS)) - 1)
+
+/* Number of entries in the table of recently seen positions. */
+#define HASH_SIZE 256
+
+/* Compresses the SRC_LEN bytes at SRC into DST, which has room
+   for DST_LEN bytes.  Returns the compressed length, or 0 if the
+   output does not fit in DST_LEN bytes. */
+size_t
+lz_compress (const void *src_, size_t src_len, void *dst_, size_t dst_len)
+{
+  const uint8_t *src = src_;
+  uint8_t *dst = dst_;
+  uint16_t lempel[HASH_SIZE] = { 0 };
+  uint8_t *copymap = NULL;
+  unsigned copymask = 1 << 7;
+  size_t s = 0, d = 0;
+
+  while (s < src_len)
+    {
+      size_t offset, cpy, mlen;
+      unsigned hash;
+      uint16_t *hp;
+
+      if ((copymask <<= 1) == (1 << 8))
+        {
+          /* Room for a flag byte and eight back-references. */
+          if (d + 1 + 2 * 8 > dst_len)
+            return 0;
+          copymask = 1;
+          copymap = &dst[d++];
+          *copymap = 0;
+        }
+      if (s + MATCH_MAX > src_len)
+        {
+          dst[d++] = src[s++];
+          continue;
+        }
+
+      hash = (src[s] << 16) + (src[s + 1] << 8) + src[s + 2];
+      hash += hash >> 9;
+      hash += hash >> 5;
+      hp = &lempel[hash & (HASH_SIZE - 1)];
+      offset = (s - *hp) & OFFSET_MASK;
+      *hp = s;
+      cpy = s - offset;
+      if (offset != 0 && src[s] == src[cpy] && src[s + 1] == src[cpy + 1]
+          && src[s + 2] == src[cpy + 2])
+        {
+          *copymap |= copymask;
+          for (mlen = MATCH_MIN; mlen < MATCH_MAX; mlen++)
+            if (src[s + mlen] != src[cpy + mlen])
+              break;
+          dst[d++] = ((mlen - MATCH_MIN) << (8 - MATCH_BITS)) | (offset >> 8);
+          dst[d++] = offset;
+          s += mlen;
+        }
+      else
+        dst[d++] = src[s++];
+    }
+  return d;
+}
+
+/* Decompresses the SRC_LEN bytes at SRC, produced by
+   lz_compress(), into DST, which has room for DST_LEN bytes.
+   Returns the decompressed length, or 0 if SRC is corrupt or
+   does not fit in DST_LEN bytes. */
+size_t
+lz_decompress (const void *src_, size_t src_len, void *dst_, size_t dst_len)
+{
+  const uint8_t *src = src_;
+  uint8_t *dst = dst_;
+  uint8_t copymap = 0;
+  unsigned copymask = 1 << 7;
+  size_t s = 0, d = 0;
+
+  while (s < src_len)
+    {
+      if ((copymask <<= 1) == (1 << 8))
+        {
+          copymask = 1;
+          copymap = src[s++];
+          if (s == src_len)
+            break;
+        }
+      if (copymap & copymask)
+        {
+          size_t mlen, offset, cpy;
+
+          if (s + 2 > src_len)
+            return 0;
+          mlen = (src[s] >> (8 - MATCH_BITS)) + MATCH_MIN;
+          offset = ((src[s] << 8) | src[s + 1]) & OFFSET_MASK;
+          s += 2;
+          if (offset == 0 || offset > d || d + mlen > dst_len)
+            return 0;
+          for (cpy = d - offset; mlen > 0; mlen--)
+            dst[d++] = dst[cpy++];
+        }
+      else
+        {
+          if (d >= dst_len)
+            return 0;
+          dst[d++] = src[s++];
+        }
+    }
+  return d;
+}
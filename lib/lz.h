@@ -0,0 +1,17 @@
+#ifndef __LIB_LZ_H
+#define __LIB_LZ_H
+
+/* A small LZ77 codec in the style of LZJB: literals and
+   back-references of 3 to 66 bytes up to 1 kB back, in groups of
+   eight behind a flag byte.  It is fast and needs no memory
+   beyond a small table on the stack, which suits compressing
+   single pages inside the kernel. */
+
+#include <stddef.h>
+
+size_t lz_compress (const void *src, size_t src_len,
+                    void *dst, size_t dst_len);
+size_t lz_decompress (const void *src, size_t src_len,
+                      void *dst, size_t dst_len);
+
+#endif /* lib/lz.h */
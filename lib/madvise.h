@@ -0,0 +1,19 @@
+#ifndef __LIB_MADVISE_H
+#define __LIB_MADVISE_H
+
+/* Access hints a process may give with madvise() for a range of
+   its pages.  NORMAL, RANDOM and SEQUENTIAL are remembered for
+   the pages and steer how much is read around a fault;
+   WILLNEED, DONTNEED and HUGEPAGE act on the pages right away. */
+enum madvise_hint
+  {
+    MADV_NORMAL,                /* No special treatment. */
+    MADV_RANDOM,                /* Read only the faulting page. */
+    MADV_SEQUENTIAL,            /* Read far ahead, drop pages behind. */
+    MADV_WILLNEED,              /* Bring the pages in now. */
+    MADV_DONTNEED,              /* Free the pages' frames and swap. */
+    MADV_HUGEPAGE               /* Back untouched zero-filled memory
+                                   with 4 MB pages where possible. */
+  };
+
+#endif /* lib/madvise.h */
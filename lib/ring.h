@@ -0,0 +1,68 @@
+#ifndef __LIB_RING_H
+#define __LIB_RING_H
+
+#include <stdint.h>
+
+/* Layout of the submission/completion ring shared between a user
+   process and the kernel.  ring_setup() maps two pages at a
+   page-aligned user address: the submission ring in the first,
+   the completion ring in the second.
+
+   The process fills in the submission entry at index
+   (tail % RING_ENTRIES) and increments the submission tail, any
+   number of times, then calls ring_enter() once.  The kernel
+   consumes entries from the submission head, posting one
+   completion per entry at the completion tail.  The process
+   reaps completions by advancing the completion head.  Indexes
+   are free-running counters; only the owner of each counter
+   ever writes it. */
+
+/* Number of entries in each ring.  Must be a power of 2. */
+#define RING_ENTRIES 128
+
+/* Operations that may be submitted. */
+enum ring_op
+  {
+    RING_OP_NOP,                /* Completes immediately with 0. */
+    RING_OP_OPEN,               /* open (ADDR), ADDR a file name. */
+    RING_OP_CLOSE,              /* close (FD). */
+    RING_OP_READ,               /* read (FD, ADDR, LEN). */
+    RING_OP_WRITE               /* write (FD, ADDR, LEN). */
+  };
+
+/* A submitted request. */
+struct ring_sqe
+  {
+    uint32_t op;                /* One of enum ring_op. */
+    int32_t fd;                 /* File descriptor, if any. */
+    uint32_t addr;              /* User buffer or file name, if any. */
+    uint32_t len;               /* Buffer length, if any. */
+    uint32_t user_data;         /* Copied to the completion as is. */
+  };
+
+/* A completed request. */
+struct ring_cqe
+  {
+    uint32_t user_data;         /* From the submission. */
+    int32_t res;                /* What the equivalent syscall returns. */
+  };
+
+/* Submission ring, first shared page.  The process owns TAIL,
+   the kernel owns HEAD. */
+struct ring_sq
+  {
+    uint32_t head;
+    uint32_t tail;
+    struct ring_sqe entries[RING_ENTRIES];
+  };
+
+/* Completion ring, second shared page.  The kernel owns TAIL,
+   the process owns HEAD. */
+struct ring_cq
+  {
+    uint32_t head;
+    uint32_t tail;
+    struct ring_cqe entries[RING_ENTRIES];
+  };
+
+#endif /* lib/ring.h */
@@ -29,7 +29,19 @@ enum
     SYS_MKDIR,                  /* Create a directory. */
     SYS_READDIR,                /* Reads a directory entry. */
     SYS_ISDIR,                  /* Tests if a fd represents a directory. */
-    SYS_INUMBER                 /* Returns the inode number for a fd. */
+    SYS_INUMBER,                /* Returns the inode number for a fd. */
+
+    /* Extensions. */
+    SYS_FALLOCATE,              /* Reserves disk space for a file. */
+    SYS_RING_SETUP,             /* Maps a submission/completion ring. */
+    SYS_RING_ENTER,             /* Processes queued ring submissions. */
+    SYS_AIO_READ,               /* Queues an asynchronous read. */
+    SYS_AIO_WRITE,              /* Queues an asynchronous write. */
+    SYS_AIO_WAIT,               /* Waits for an asynchronous request. */
+    SYS_FORK,                   /* Duplicates the current process. */
+    SYS_MADVISE,                /* Gives an access hint for pages. */
+    SYS_SETSTACKLIMIT,          /* Sets the most stack a process may use. */
+    SYS_SBRK                    /* Moves the end of the heap. */
   };
 
 #endif /* lib/syscall-nr.h */
@@ -0,0 +1,389 @@
+#include <stdlib.h>
+#include <debug.h>
+#include <round.h>
+#include <stdint.h>
+#include <string.h>
+#include <syscall.h>
+
+/* A malloc() for user programs, on top of sbrk().
+
+   It works like the kernel's (see threads/malloc.c).  Each
+   request is rounded up to a power of 2 and served from the free
+   list of the "descriptor" for blocks of that size.  If the list is
+   empty, a new page, called an "arena", is divided into blocks for
+   it, and an arena whose blocks are all free again is given back.
+   Requests too big for any descriptor get a run of whole pages
+   with the arena header at its start.
+
+   The heap only grows and shrinks at its end, so pages given back
+   are kept in a list of free runs of pages, sorted by address and
+   merged with their neighbors, and reused first fit.  A free run
+   at the end of the heap is returned to the kernel with sbrk().
+
+   User processes have a single thread, so there is no locking. */
+
+/* Page size, as in threads/vaddr.h. */
+#define PGSIZE 4096
+
+/* Free block. */
+struct block
+  {
+    struct block *prev;         /* Previous free block of its size. */
+    struct block *next;         /* Next free block of its size. */
+  };
+
+/* Descriptor. */
+struct desc
+  {
+    size_t block_size;          /* Size of each element in bytes. */
+    size_t blocks_per_arena;    /* Number of blocks in an arena. */
+    struct block *free_list;    /* First free block, if any. */
+  };
+
+/* Magic number for detecting arena corruption. */
+#define ARENA_MAGIC 0x9a548eed
+
+/* Arena. */
+struct arena
+  {
+    unsigned magic;             /* Always set to ARENA_MAGIC. */
+    struct desc *desc;          /* Owning descriptor, null for big block. */
+    size_t free_cnt;            /* Free blocks; pages in big block. */
+  };
+
+/* Run of free pages, at its start. */
+struct run
+  {
+    struct run *next;           /* Next run, at a higher address. */
+    size_t page_cnt;            /* Number of pages in the run. */
+  };
+
+/* Our set of descriptors. */
+static struct desc descs[10];   /* Descriptors. */
+static size_t desc_cnt;         /* Number of descriptors. */
+
+/* Free runs of pages, by address. */
+static struct run *free_runs;
+
+static void malloc_init (void);
+static void *pages_get (size_t page_cnt);
+static void pages_free (void *, size_t page_cnt);
+static struct arena *block_to_arena (struct block *);
+static struct block *arena_to_block (struct arena *, size_t idx);
+
+/* Initializes the malloc() descriptors. */
+static void
+malloc_init (void)
+{
+  size_t block_size;
+
+  for (block_size = 16; block_size < PGSIZE / 2; block_size *= 2)
+    {
+      struct desc *d = &descs[desc_cnt++];
+      ASSERT (desc_cnt <= sizeof descs / sizeof *descs);
+      d->block_size = block_size;
+      d->blocks_per_arena = (PGSIZE - sizeof (struct arena)) / block_size;
+      d->free_list = NULL;
+    }
+}
+
+/* Adds B to the front of D's free list. */
+static void
+block_push (struct desc *d, struct block *b)
+{
+  b->prev = NULL;
+  b->next = d->free_list;
+  if (b->next != NULL)
+    b->next->prev = b;
+  d->free_list = b;
+}
+
+/* Removes B from D's free list. */
+static void
+block_remove (struct desc *d, struct block *b)
+{
+  if (b->prev != NULL)
+    b->prev->next = b->next;
+  else
+    d->free_list = b->next;
+  if (b->next != NULL)
+    b->next->prev = b->prev;
+}
+
+/* Obtains and returns a new block of at least SIZE bytes.
+   Returns a null pointer if memory is not available. */
+void *
+malloc (size_t size)
+{
+  struct desc *d;
+  struct block *b;
+  struct arena *a;
+
+  /* A null pointer satisfies a request for 0 bytes. */
+  if (size == 0)
+    return NULL;
+  if (desc_cnt == 0)
+    malloc_init ();
+
+  /* Find the smallest descriptor that satisfies a SIZE-byte
+     request. */
+  for (d = descs; d < descs + desc_cnt; d++)
+    if (d->block_size >= size)
+      break;
+  if (d == descs + desc_cnt)
+    {
+      /* SIZE is too big for any descriptor.
+         Allocate enough pages to hold SIZE plus an arena. */
+      size_t page_cnt;
+
+      if (size > SIZE_MAX - sizeof *a - PGSIZE)
+        return NULL;
+      page_cnt = DIV_ROUND_UP (size + sizeof *a, PGSIZE);
+      a = pages_get (page_cnt);
+      if (a == NULL)
+        return NULL;
+
+      /* Initialize the arena to indicate a big block of PAGE_CNT
+         pages, and return it. */
+      a->magic = ARENA_MAGIC;
+      a->desc = NULL;
+      a->free_cnt = page_cnt;
+      return a + 1;
+    }
+
+  /* If the free list is empty, create a new arena. */
+  if (d->free_list == NULL)
+    {
+      size_t i;
+
+      /* Allocate a page. */
+      a = pages_get (1);
+      if (a == NULL)
+        return NULL;
+
+      /* Initialize arena and add its blocks to the free list. */
+      a->magic = ARENA_MAGIC;
+      a->desc = d;
+      a->free_cnt = d->blocks_per_arena;
+      for (i = d->blocks_per_arena; i-- > 0; )
+        block_push (d, arena_to_block (a, i));
+    }
+
+  /* Get a block from free list and return it. */
+  b = d->free_list;
+  block_remove (d, b);
+  a = block_to_arena (b);
+  a->free_cnt--;
+  return b;
+}
+
+/* Allocates and return A times B bytes initialized to zeroes.
+   Returns a null pointer if memory is not available. */
+void *
+calloc (size_t a, size_t b)
+{
+  void *p;
+  size_t size;
+
+  /* Calculate block size and make sure it fits in size_t. */
+  if (b != 0 && a > SIZE_MAX / b)
+    return NULL;
+  size = a * b;
+
+  /* Allocate and zero memory. */
+  p = malloc (size);
+  if (p != NULL)
+    memset (p, 0, size);
+
+  return p;
+}
+
+/* Returns the number of bytes allocated for BLOCK. */
+static size_t
+block_size (void *block)
+{
+  struct block *b = block;
+  struct arena *a = block_to_arena (b);
+  struct desc *d = a->desc;
+
+  return d != NULL ? d->block_size : PGSIZE * a->free_cnt - sizeof *a;
+}
+
+/* Attempts to resize OLD_BLOCK to NEW_SIZE bytes, possibly
+   moving it in the process.  A block that is big enough already
+   stays where it is.
+   If successful, returns the new block; on failure, returns a
+   null pointer.
+   A call with null OLD_BLOCK is equivalent to malloc(NEW_SIZE).
+   A call with zero NEW_SIZE is equivalent to free(OLD_BLOCK). */
+void *
+realloc (void *old_block, size_t new_size)
+{
+  if (new_size == 0)
+    {
+      free (old_block);
+      return NULL;
+    }
+  else if (old_block != NULL && block_size (old_block) >= new_size)
+    return old_block;
+  else
+    {
+      void *new_block = malloc (new_size);
+      if (old_block != NULL && new_block != NULL)
+        {
+          size_t old_size = block_size (old_block);
+          size_t min_size = new_size < old_size ? new_size : old_size;
+          memcpy (new_block, old_block, min_size);
+          free (old_block);
+        }
+      return new_block;
+    }
+}
+
+/* Frees block P, which must have been previously allocated with
+   malloc(), calloc(), or realloc(). */
+void
+free (void *p)
+{
+  if (p != NULL)
+    {
+      struct block *b = p;
+      struct arena *a = block_to_arena (b);
+      struct desc *d = a->desc;
+
+      if (d != NULL)
+        {
+          /* It's a normal block.  We handle it here. */
+
+          /* Add block to free list. */
+          block_push (d, b);
+
+          /* If the arena is now entirely unused, free it. */
+          if (++a->free_cnt >= d->blocks_per_arena)
+            {
+              size_t i;
+
+              ASSERT (a->free_cnt == d->blocks_per_arena);
+              for (i = 0; i < d->blocks_per_arena; i++)
+                block_remove (d, arena_to_block (a, i));
+              pages_free (a, 1);
+            }
+        }
+      else
+        {
+          /* It's a big block.  Free its pages. */
+          pages_free (a, a->free_cnt);
+        }
+    }
+}
+
+/* Returns PAGE_CNT contiguous pages, reusing a free run if one is
+   big enough and growing the heap otherwise.  Returns a null
+   pointer if the heap cannot grow. */
+static void *
+pages_get (size_t page_cnt)
+{
+  struct run **rp;
+  uint8_t *brk, *pages;
+  size_t pad;
+
+  for (rp = &free_runs; *rp != NULL; rp = &(*rp)->next)
+    {
+      struct run *r = *rp;
+
+      if (r->page_cnt == page_cnt)
+        {
+          *rp = r->next;
+          return r;
+        }
+      if (r->page_cnt > page_cnt)
+        {
+          /* Take the end of the run, so its header stays put. */
+          r->page_cnt -= page_cnt;
+          return (uint8_t *) r + r->page_cnt * PGSIZE;
+        }
+    }
+
+  /* Arenas must be page-aligned, but someone else may have
+     called sbrk() with an odd size. */
+  brk = sbrk (0);
+  if (brk == (void *) -1 || page_cnt > (SIZE_MAX - PGSIZE) / PGSIZE)
+    return NULL;
+  pad = ROUND_UP ((uintptr_t) brk, PGSIZE) - (uintptr_t) brk;
+  pages = sbrk (pad + page_cnt * PGSIZE);
+  if (pages == (void *) -1)
+    return NULL;
+  return pages + pad;
+}
+
+/* Frees the PAGE_CNT pages at PAGES, merging them with adjacent
+   free runs.  If the result ends at the end of the heap, it is
+   given back to the kernel. */
+static void
+pages_free (void *pages, size_t page_cnt)
+{
+  struct run *r = pages, *prev = NULL, *next;
+
+  for (next = free_runs; next != NULL && next < r; next = next->next)
+    prev = next;
+
+  r->page_cnt = page_cnt;
+  r->next = next;
+  if (next != NULL && (uint8_t *) r + page_cnt * PGSIZE == (uint8_t *) next)
+    {
+      r->page_cnt += next->page_cnt;
+      r->next = next->next;
+    }
+  if (prev != NULL
+      && (uint8_t *) prev + prev->page_cnt * PGSIZE == (uint8_t *) r)
+    {
+      prev->page_cnt += r->page_cnt;
+      prev->next = r->next;
+      r = prev;
+    }
+  else if (prev != NULL)
+    prev->next = r;
+  else
+    free_runs = r;
+
+  if (r->next == NULL
+      && (uint8_t *) r + r->page_cnt * PGSIZE == (uint8_t *) sbrk (0)
+      && sbrk (-(intptr_t) (r->page_cnt * PGSIZE)) != (void *) -1)
+    {
+      struct run **rp;
+
+      for (rp = &free_runs; *rp != r; rp = &(*rp)->next)
+        continue;
+      *rp = NULL;
+    }
+}
+
+/* Returns the arena that block B is inside. */
+static struct arena *
+block_to_arena (struct block *b)
+{
+  struct arena *a = (struct arena *) ((uintptr_t) b & ~(uintptr_t) (PGSIZE - 1));
+
+  /* Check that the arena is valid. */
+  ASSERT (a != NULL);
+  ASSERT (a->magic == ARENA_MAGIC);
+
+  /* Check that the block is properly aligned for the arena. */
+  ASSERT (a->desc == NULL
+          || ((uintptr_t) b % PGSIZE - sizeof *a) % a->desc->block_size == 0);
+  ASSERT (a->desc != NULL || (uintptr_t) b % PGSIZE == sizeof *a);
+
+  return a;
+}
+
+/* Returns the (IDX - 1)'th block within arena A. */
+static struct block *
+arena_to_block (struct arena *a, size_t idx)
+{
+  ASSERT (a != NULL);
+  ASSERT (a->magic == ARENA_MAGIC);
+  ASSERT (idx < a->desc->blocks_per_arena);
+  return (struct block *) ((uint8_t *) a
+                           + sizeof *a
+                           + idx * a->desc->block_size);
+}
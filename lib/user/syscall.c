@@ -61,6 +61,25 @@
           retval;                                               \
         })
 
+/* Invokes syscall NUMBER, passing arguments ARG0, ARG1, ARG2,
+   and ARG3, and returns the return value as an `int'. */
+#define syscall4(NUMBER, ARG0, ARG1, ARG2, ARG3)                \
+        ({                                                      \
+          int retval;                                           \
+          asm volatile                                          \
+            ("pushl %[arg3]; pushl %[arg2]; pushl %[arg1]; "    \
+             "pushl %[arg0]; pushl %[number]; int $0x30; "      \
+             "addl $20, %%esp"                                  \
+               : "=a" (retval)                                  \
+               : [number] "i" (NUMBER),                         \
+                 [arg0] "r" (ARG0),                             \
+                 [arg1] "r" (ARG1),                             \
+                 [arg2] "r" (ARG2),                             \
+                 [arg3] "r" (ARG3)                              \
+               : "memory");                                     \
+          retval;                                               \
+        })
+
 void
 halt (void) 
 {
@@ -182,3 +201,74 @@ inumber (int fd)
 {
   return syscall1 (SYS_INUMBER, fd);
 }
+
+bool
+fallocate (int fd, unsigned offset, unsigned length)
+{
+  return syscall3 (SYS_FALLOCATE, fd, offset, length);
+}
+
+bool
+ring_setup (void *addr)
+{
+  return syscall1 (SYS_RING_SETUP, addr);
+}
+
+int
+ring_enter (unsigned to_submit)
+{
+  return syscall1 (SYS_RING_ENTER, to_submit);
+}
+
+int
+aio_read (int fd, void *buffer, unsigned size, unsigned offset)
+{
+  return syscall4 (SYS_AIO_READ, fd, buffer, size, offset);
+}
+
+int
+aio_write (int fd, const void *buffer, unsigned size, unsigned offset)
+{
+  return syscall4 (SYS_AIO_WRITE, fd, buffer, size, offset);
+}
+
+int
+aio_wait (int id)
+{
+  return syscall1 (SYS_AIO_WAIT, id);
+}
+
+pid_t
+fork (void)
+{
+  return (pid_t) syscall0 (SYS_FORK);
+}
+
+int
+madvise (void *addr, unsigned length, int advice)
+{
+  return syscall3 (SYS_MADVISE, addr, length, advice);
+}
+
+int
+setstacklimit (unsigned size)
+{
+  return syscall1 (SYS_SETSTACKLIMIT, size);
+}
+
+void *
+sbrk (intptr_t increment)
+{
+  return (void *) syscall1 (SYS_SBRK, increment);
+}
+
+int
+brk (void *addr)
+{
+  void *cur = sbrk (0);
+
+  if (cur == (void *) -1
+      || sbrk ((char *) addr - (char *) cur) == (void *) -1)
+    return -1;
+  return 0;
+}
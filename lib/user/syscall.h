@@ -2,6 +2,7 @@
 #define __LIB_USER_SYSCALL_H
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <debug.h>
 
 /* Process identifier. */
@@ -45,4 +46,17 @@ bool readdir (int fd, char name[READDIR_MAX_LEN + 1]);
 bool isdir (int fd);
 int inumber (int fd);
 
+/* Extensions. */
+bool fallocate (int fd, unsigned offset, unsigned length);
+bool ring_setup (void *addr);
+int ring_enter (unsigned to_submit);
+int aio_read (int fd, void *buffer, unsigned size, unsigned offset);
+int aio_write (int fd, const void *buffer, unsigned size, unsigned offset);
+int aio_wait (int id);
+pid_t fork (void);
+int madvise (void *addr, unsigned length, int advice);
+int setstacklimit (unsigned size);
+void *sbrk (intptr_t increment);
+int brk (void *addr);
+
 #endif /* lib/user/syscall.h */
@@ -0,0 +1,47 @@
+/* Reads "sample.txt" in chunks with several asynchronous reads
+   in flight at once, then waits for them out of order. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/userprog/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define CHUNK 64
+#define MAX_CHUNKS 16
+
+static char buf[sizeof sample - 1];
+
+void
+test_main (void) 
+{
+  int ids[MAX_CHUNKS];
+  unsigned i, chunks;
+  int fd;
+
+  CHECK ((fd = open ("sample.txt")) > 1, "open \"sample.txt\"");
+
+  chunks = (sizeof buf + CHUNK - 1) / CHUNK;
+  if (chunks > MAX_CHUNKS)
+    fail ("sample.txt too large for this test");
+  for (i = 0; i < chunks; i++)
+    {
+      unsigned len = sizeof buf - i * CHUNK < CHUNK ? sizeof buf - i * CHUNK : CHUNK;
+      ids[i] = aio_read (fd, buf + i * CHUNK, len, i * CHUNK);
+      if (ids[i] < 0)
+        fail ("aio_read of chunk %u failed", i);
+    }
+  msg ("submitted reads");
+
+  for (i = chunks; i-- > 0; )
+    {
+      unsigned len = sizeof buf - i * CHUNK < CHUNK ? sizeof buf - i * CHUNK : CHUNK;
+      int n = aio_wait (ids[i]);
+      if (n != (int) len)
+        fail ("chunk %u read %d bytes, expected %u", i, n, len);
+    }
+  CHECK (aio_wait (ids[0]) == -1, "wait on completed request");
+
+  compare_bytes (buf, sample, sizeof buf, 0, "sample.txt");
+  msg ("verified contents of \"sample.txt\"");
+}
@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(aio-read) begin
+(aio-read) open "sample.txt"
+(aio-read) submitted reads
+(aio-read) wait on completed request
+(aio-read) verified contents of "sample.txt"
+(aio-read) end
+aio-read: exit(0)
+EOF
+pass;
@@ -0,0 +1,33 @@
+/* Preallocates space in an empty file, checks that the file grew
+   to the reserved size and reads back as zeros, and that writes
+   into the reserved range do not change its size. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static char buf[5000];
+
+void
+test_main (void) 
+{
+  size_t i;
+  int handle;
+
+  CHECK (create ("log", 0), "create \"log\"");
+  CHECK ((handle = open ("log")) > 1, "open \"log\"");
+  CHECK (fallocate (handle, 0, sizeof buf), "fallocate \"log\"");
+  CHECK (filesize (handle) == (int) sizeof buf,
+         "filesize \"log\" after fallocate");
+  CHECK (read (handle, buf, sizeof buf) == (int) sizeof buf, "read \"log\"");
+  for (i = 0; i < sizeof buf; i++)
+    if (buf[i] != 0)
+      fail ("byte %zu of \"log\" is %d, not zero", i, buf[i]);
+
+  seek (handle, 0);
+  CHECK (write (handle, "sample", 6) == 6, "write into reserved range");
+  CHECK (filesize (handle) == (int) sizeof buf,
+         "filesize \"log\" after write");
+  msg ("close \"log\"");
+  close (handle);
+}
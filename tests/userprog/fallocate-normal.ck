@@ -0,0 +1,18 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(fallocate-normal) begin
+(fallocate-normal) create "log"
+(fallocate-normal) open "log"
+(fallocate-normal) fallocate "log"
+(fallocate-normal) filesize "log" after fallocate
+(fallocate-normal) read "log"
+(fallocate-normal) write into reserved range
+(fallocate-normal) filesize "log" after write
+(fallocate-normal) close "log"
+(fallocate-normal) end
+fallocate-normal: exit(0)
+EOF
+pass;
@@ -0,0 +1,30 @@
+/* Forks a child that changes a global and a stack variable, and
+   checks that the changes stay out of the parent's memory. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static int global = 17;
+
+void
+test_main (void) 
+{
+  volatile int local = 42;
+  pid_t pid;
+
+  pid = fork ();
+  if (pid == 0)
+    {
+      global = 1;
+      local = 2;
+      exit (80 + global + local);
+    }
+  if (pid < 0)
+    fail ("fork returned %d", pid);
+
+  CHECK (wait (pid) == 83, "wait for child");
+  if (global != 17 || local != 42)
+    fail ("parent sees global=%d local=%d", global, local);
+  msg ("parent's memory unchanged");
+}
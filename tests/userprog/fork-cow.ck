@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(fork-cow) begin
+fork-cow: exit(83)
+(fork-cow) wait for child
+(fork-cow) parent's memory unchanged
+(fork-cow) end
+fork-cow: exit(0)
+EOF
+pass;
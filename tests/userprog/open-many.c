@@ -0,0 +1,31 @@
+/* Opens the same file more times than the old fixed-size
+   descriptor table allowed, checks that every descriptor is
+   distinct, then closes one and checks that the lowest free
+   descriptor is handed out again. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define OPEN_CNT 200
+
+static int handles[OPEN_CNT];
+
+void
+test_main (void) 
+{
+  int i;
+
+  for (i = 0; i < OPEN_CNT; i++)
+    {
+      handles[i] = open ("sample.txt");
+      if (handles[i] < 2)
+        fail ("open #%d returned %d", i, handles[i]);
+      if (i > 0 && handles[i] <= handles[i - 1])
+        fail ("open #%d returned %d after %d", i, handles[i], handles[i - 1]);
+    }
+  msg ("opened \"sample.txt\" %d times", OPEN_CNT);
+
+  close (handles[10]);
+  CHECK (open ("sample.txt") == handles[10], "reopen reuses closed handle");
+}
@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(open-many) begin
+(open-many) opened "sample.txt" 200 times
+(open-many) reopen reuses closed handle
+(open-many) end
+open-many: exit(0)
+EOF
+pass;
@@ -0,0 +1,70 @@
+/* Opens, reads and closes "sample.txt" through the submission
+   ring, issuing all of the reads with a single ring_enter(). */
+
+#include <ring.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/userprog/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define RING_BASE ((char *) 0x10000000)
+#define CHUNK 64
+
+static struct ring_sq *sq = (struct ring_sq *) RING_BASE;
+static struct ring_cq *cq = (struct ring_cq *) (RING_BASE + 4096);
+static char buf[sizeof sample - 1];
+
+static void
+submit (enum ring_op op, int fd, void *addr, unsigned len, unsigned id)
+{
+  struct ring_sqe *sqe = &sq->entries[sq->tail % RING_ENTRIES];
+  sqe->op = op;
+  sqe->fd = fd;
+  sqe->addr = (uint32_t) addr;
+  sqe->len = len;
+  sqe->user_data = id;
+  sq->tail++;
+}
+
+static struct ring_cqe *
+reap (void)
+{
+  if (cq->head == cq->tail)
+    fail ("completion ring empty");
+  return &cq->entries[cq->head++ % RING_ENTRIES];
+}
+
+void
+test_main (void) 
+{
+  struct ring_cqe *cqe;
+  unsigned i, chunks;
+  int fd;
+
+  CHECK (ring_setup (RING_BASE), "ring_setup");
+
+  submit (RING_OP_OPEN, 0, "sample.txt", 0, 0);
+  CHECK (ring_enter (1) == 1, "submit open");
+  cqe = reap ();
+  CHECK ((fd = cqe->res) > 1, "open \"sample.txt\"");
+
+  chunks = (sizeof buf + CHUNK - 1) / CHUNK;
+  for (i = 0; i < chunks; i++)
+    {
+      unsigned len = sizeof buf - i * CHUNK < CHUNK ? sizeof buf - i * CHUNK : CHUNK;
+      submit (RING_OP_READ, fd, buf + i * CHUNK, len, i);
+    }
+  CHECK (ring_enter (chunks) == (int) chunks, "submit reads");
+  for (i = 0; i < chunks; i++)
+    {
+      cqe = reap ();
+      if (cqe->user_data != i || cqe->res <= 0)
+        fail ("read %u completed as %u with %d", i, cqe->user_data, cqe->res);
+    }
+  compare_bytes (buf, sample, sizeof buf, 0, "sample.txt");
+  msg ("verified contents of \"sample.txt\"");
+
+  submit (RING_OP_CLOSE, fd, NULL, 0, 0);
+  CHECK (ring_enter (1) == 1 && reap ()->res == 0, "close \"sample.txt\"");
+}
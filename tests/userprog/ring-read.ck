@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(ring-read) begin
+(ring-read) ring_setup
+(ring-read) submit open
+(ring-read) open "sample.txt"
+(ring-read) submit reads
+(ring-read) verified contents of "sample.txt"
+(ring-read) close "sample.txt"
+(ring-read) end
+ring-read: exit(0)
+EOF
+pass;
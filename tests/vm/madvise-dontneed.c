@@ -0,0 +1,56 @@
+/* Gives madvise() hints for a mapped file and for bss, and
+   verifies that MADV_DONTNEED writes back a changed mapped page
+   and makes an anonymous page read as zeros again. */
+
+#include <string.h>
+#include <syscall.h>
+#include <madvise.h>
+#include "tests/vm/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static char bss[2 * 4096];
+
+void
+test_main (void)
+{
+  static const char overwrite[] = "Now is the time for all good...";
+  static char buffer[sizeof sample - 1];
+  char *actual = (char *) 0x54321000;
+  char *page = (char *) (((unsigned) bss + 4095) & ~4095u);
+  size_t i;
+  int handle;
+  mapid_t map;
+
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK ((map = mmap (handle, actual)) != MAP_FAILED, "mmap \"sample.txt\"");
+  CHECK (madvise (actual, 4096, MADV_SEQUENTIAL) == 0, "madvise sequential");
+  CHECK (madvise (actual, 4096, MADV_WILLNEED) == 0, "madvise willneed");
+  if (memcmp (actual, sample, strlen (sample)))
+    fail ("read of mmap'd file reported bad data");
+
+  /* Change the mapping, then drop it: the change must reach the
+     file, and the mapping must read it back from there. */
+  memcpy (actual, overwrite, strlen (overwrite));
+  CHECK (madvise (actual, 4096, MADV_DONTNEED) == 0, "madvise dontneed");
+  CHECK (read (handle, buffer, sizeof buffer) == sizeof buffer,
+         "read \"sample.txt\"");
+  if (memcmp (buffer, overwrite, strlen (overwrite)))
+    fail ("madvise dontneed did not write back changed page");
+  if (memcmp (actual, overwrite, strlen (overwrite))
+      || memcmp (actual + strlen (overwrite), sample + strlen (overwrite),
+                 strlen (sample) - strlen (overwrite)))
+    fail ("mapping reads surprising data after madvise dontneed");
+
+  /* A dropped anonymous page reads as zeros. */
+  memset (page, 'x', 4096);
+  CHECK (madvise (page, 4096, MADV_DONTNEED) == 0, "madvise dontneed bss");
+  for (i = 0; i < 4096; i++)
+    if (page[i] != 0)
+      fail ("byte %zu of bss page is %d after madvise dontneed", i, page[i]);
+
+  CHECK (madvise (actual + 1, 4096, MADV_NORMAL) == -1,
+         "madvise misaligned address");
+  CHECK (madvise (actual, 4096, 42) == -1, "madvise bad hint");
+  munmap (map);
+}
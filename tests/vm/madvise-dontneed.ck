@@ -0,0 +1,18 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(madvise-dontneed) begin
+(madvise-dontneed) open "sample.txt"
+(madvise-dontneed) mmap "sample.txt"
+(madvise-dontneed) madvise sequential
+(madvise-dontneed) madvise willneed
+(madvise-dontneed) madvise dontneed
+(madvise-dontneed) read "sample.txt"
+(madvise-dontneed) madvise dontneed bss
+(madvise-dontneed) madvise misaligned address
+(madvise-dontneed) madvise bad hint
+(madvise-dontneed) end
+EOF
+pass;
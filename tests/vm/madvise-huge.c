@@ -0,0 +1,35 @@
+/* Asks for 4 MB pages for a large zero-filled array, then checks
+   that the array reads as zeros and keeps what is written to it,
+   whether or not the kernel could back it with large pages. */
+
+#include <string.h>
+#include <syscall.h>
+#include <madvise.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SIZE (8 * 1024 * 1024)
+#define STRIDE (64 * 1024)
+
+static char big[SIZE + 4096];
+
+void
+test_main (void)
+{
+  char *start = (char *) (((unsigned) big + 4095) & ~4095u);
+  size_t i;
+
+  CHECK (madvise (start, SIZE, MADV_HUGEPAGE) == 0, "madvise hugepage");
+
+  for (i = 0; i < SIZE; i += STRIDE)
+    {
+      if (start[i] != 0)
+        fail ("byte %zu is %d before being written", i, start[i]);
+      start[i] = i / STRIDE + 1;
+    }
+  for (i = 0; i < SIZE; i += STRIDE)
+    if (start[i] != (char) (i / STRIDE + 1))
+      fail ("byte %zu is %d, expected %d", i, start[i],
+            (char) (i / STRIDE + 1));
+  msg ("array holds its contents");
+}
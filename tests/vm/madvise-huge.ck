@@ -0,0 +1,11 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(madvise-huge) begin
+(madvise-huge) madvise hugepage
+(madvise-huge) array holds its contents
+(madvise-huge) end
+EOF
+pass;
@@ -0,0 +1,28 @@
+/* Lowers the stack limit to 64 kB, then allocates and writes a
+   32 kB object on the stack, which must succeed, and a 128 kB
+   one, which must terminate the process with -1 exit code. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static void NO_INLINE
+fill (size_t size)
+{
+  char stk_obj[size];
+
+  memset (stk_obj, 0x5a, size);
+  if (stk_obj[0] != 0x5a || stk_obj[size - 1] != 0x5a)
+    fail ("stack object lost its contents");
+}
+
+void
+test_main (void)
+{
+  CHECK (setstacklimit (65536) == 0, "set stack limit");
+  fill (32768);
+  msg ("32 kB stack object");
+  fill (131072);
+  fail ("128 kB stack object should have failed");
+}
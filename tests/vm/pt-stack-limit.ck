@@ -0,0 +1,11 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_USER_FAULTS => 1, [<<'EOF']);
+(pt-stack-limit) begin
+(pt-stack-limit) set stack limit
+(pt-stack-limit) 32 kB stack object
+pt-stack-limit: exit(-1)
+EOF
+pass;
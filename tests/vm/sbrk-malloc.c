@@ -0,0 +1,105 @@
+/* Grows the heap with sbrk(), then allocates blocks of many sizes
+   with malloc(), fills them, checks them after freeing every other
+   one, and checks that realloc() keeps the contents.  Last, forks
+   while the top of the heap is in use, and checks that both
+   processes can give it back and malloc() again, although the
+   pages are shared copy-on-write. */
+
+#include <stdlib.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define BLOCK_CNT 64
+
+static char *blocks[BLOCK_CNT];
+
+static size_t
+block_len (int i)
+{
+  return 1 + (size_t) i * i * 13;
+}
+
+static bool
+block_ok (int i)
+{
+  size_t j;
+
+  for (j = 0; j < block_len (i); j++)
+    if (blocks[i][j] != (char) (i + j))
+      return false;
+  return true;
+}
+
+/* Frees P, which must end at the break, and checks that the break
+   went down and that a block of the same size can be had again. */
+static bool
+heap_cycle (char *p)
+{
+  char *brk = sbrk (0);
+
+  free (p);
+  if ((char *) sbrk (0) >= brk)
+    return false;
+  p = malloc (3 * 4096);
+  if (p == NULL)
+    return false;
+  memset (p, 'y', 3 * 4096);
+  free (p);
+  return true;
+}
+
+void
+test_main (void)
+{
+  char *brk0, *p;
+  pid_t pid;
+  size_t j;
+  int i;
+
+  brk0 = sbrk (0);
+  CHECK (brk0 != (void *) -1, "sbrk (0)");
+  p = sbrk (8192);
+  CHECK (p == brk0 && sbrk (0) == brk0 + 8192, "sbrk (8192)");
+  memset (p, 0x5a, 8192);
+  CHECK (sbrk (-8192) == brk0 + 8192 && sbrk (0) == brk0, "sbrk (-8192)");
+
+  for (i = 0; i < BLOCK_CNT; i++)
+    {
+      blocks[i] = malloc (block_len (i));
+      if (blocks[i] == NULL)
+        fail ("malloc of %zu bytes failed", block_len (i));
+      for (j = 0; j < block_len (i); j++)
+        blocks[i][j] = i + j;
+    }
+  msg ("malloc %d blocks", BLOCK_CNT);
+
+  for (i = 0; i < BLOCK_CNT; i += 2)
+    free (blocks[i]);
+  for (i = 1; i < BLOCK_CNT; i += 2)
+    if (!block_ok (i))
+      fail ("block %d lost its contents", i);
+  msg ("free every other block");
+
+  for (i = 1; i < BLOCK_CNT; i += 2)
+    {
+      blocks[i] = realloc (blocks[i], 2 * block_len (i));
+      if (blocks[i] == NULL || !block_ok (i))
+        fail ("realloc of block %d failed", i);
+      free (blocks[i]);
+    }
+  msg ("realloc keeps contents");
+
+  p = malloc (3 * 4096);
+  if (p == NULL)
+    fail ("malloc before fork failed");
+  memset (p, 'x', 3 * 4096);
+  pid = fork ();
+  if (pid == 0)
+    exit (heap_cycle (p) ? 81 : 82);
+  if (pid < 0)
+    fail ("fork returned %d", pid);
+  CHECK (wait (pid) == 81, "child frees and mallocs after fork");
+  CHECK (heap_cycle (p), "parent frees and mallocs after fork");
+}
@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(sbrk-malloc) begin
+(sbrk-malloc) sbrk (0)
+(sbrk-malloc) sbrk (8192)
+(sbrk-malloc) sbrk (-8192)
+(sbrk-malloc) malloc 64 blocks
+(sbrk-malloc) free every other block
+(sbrk-malloc) realloc keeps contents
+(sbrk-malloc) child frees and mallocs after fork
+(sbrk-malloc) parent frees and mallocs after fork
+(sbrk-malloc) end
+EOF
+pass;
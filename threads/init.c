@@ -25,14 +25,20 @@
 #include "threads/pte.h"
 #include "threads/thread.h"
 #ifdef USERPROG
+#include "userprog/aio.h"
 #include "userprog/process.h"
 #include "userprog/exception.h"
 #include "userprog/gdt.h"
+#include "userprog/pagedir.h"
 #include "userprog/syscall.h"
 #include "userprog/tss.h"
 #else
 #include "tests/threads/tests.h"
 #endif
+#ifdef VM
+#include "vm/frame.h"
+#include "vm/swap.h"
+#endif
 #ifdef FILESYS
 #include "devices/block.h"
 #include "devices/ide.h"
@@ -47,6 +53,7 @@
 /* Page directory with kernel mappings only. */
 uint32_t *base_page_dir;
 bool base_page_dir_initialized = 0;
+bool paging_large_pages;
 
 #ifdef FILESYS
 /* -f: Format the file system? */
@@ -111,6 +118,12 @@ main (void)
   palloc_init ();
   malloc_init ();
   paging_init ();
+#ifdef USERPROG
+  pagedir_init ();
+#endif
+#ifdef VM
+  frame_init ();
+#endif
 
   /* Segmentation. */
 #ifdef USERPROG
@@ -143,6 +156,13 @@ main (void)
   locate_block_devices ();
   filesys_init (format_filesys);
 #endif
+#ifdef VM
+  swap_init ();
+#endif
+
+#ifdef USERPROG
+  aio_init ();
+#endif
 ////////////////////////////////////////////////////////////////////////////////
 struct thread *t = get_thread_by_tid(1);
 t->cwd = dir_open_root();
@@ -174,10 +194,44 @@ bss_init (void)
   memset (&_start_bss, 0, &_end_bss - &_start_bss);
 }
 
+/* Returns true if the CPU supports 4 MB pages.  See [IA32-v2a]
+   "CPUID--CPU Identification". */
+static bool
+cpu_has_pse (void) 
+{
+  uint32_t eax = 1, ebx, ecx = 0, edx;
+
+  asm volatile ("cpuid" : "+a" (eax), "=b" (ebx), "+c" (ecx), "=d" (edx));
+  return (edx & (1 << 3)) != 0;
+}
+
+/* Returns true if the 4 MB of physical memory at PADDR, a
+   multiple of 4 MB, can be mapped with one large page.  That
+   leaves out the kernel text, which stays read-only, and the
+   user pool, whose per-page dirty bits the VM reads through the
+   kernel mapping. */
+static bool
+large_page_ok (uintptr_t paddr) 
+{
+  extern char _start, _end_kernel_text;
+  uintptr_t i;
+
+  if (!paging_large_pages || paddr + LARGE_PGSIZE > ram_pages * PGSIZE)
+    return false;
+  if (paddr < vtop (&_end_kernel_text) && vtop (&_start) < paddr + LARGE_PGSIZE)
+    return false;
+  for (i = 0; i < LARGE_PGSIZE; i += PGSIZE)
+    if (palloc_user_page_idx (ptov (paddr + i)) != SIZE_MAX)
+      return false;
+  return true;
+}
+
 /* Populates the base page directory and page table with the
    kernel virtual mapping, and then sets up the CPU to use the
    new page directory.  Points base_page_dir to the page
-   directory it creates. */
+   directory it creates.  Where the CPU supports it, whole 4 MB
+   runs of memory are mapped with a single large page, which
+   saves their page tables and TLB entries. */
 static void
 paging_init (void)
 {
@@ -185,6 +239,7 @@ paging_init (void)
   size_t page;
   extern char _start, _end_kernel_text;
 
+  paging_large_pages = cpu_has_pse ();
   pd = base_page_dir = palloc_get_page (PAL_ASSERT | PAL_ZERO);
   pt = NULL;
   for (page = 0; page < ram_pages; page++) 
@@ -197,6 +252,12 @@ paging_init (void)
 
       if (pd[pde_idx] == 0)
         {
+          if (large_page_ok (paddr))
+            {
+              pd[pde_idx] = pde_create_kernel_large (vaddr);
+              page += LARGE_PG_CNT - 1;
+              continue;
+            }
           pt = palloc_get_page (PAL_ASSERT | PAL_ZERO);
           pd[pde_idx] = pde_create_kernel (pt);
         }
@@ -206,6 +267,15 @@ paging_init (void)
 
   pci_zone_init ();
 
+  /* Turn on 4 MB pages before any large PDE is used.  See
+     [IA32-v3a] 2.5 "Control Registers". */
+  if (paging_large_pages)
+    {
+      uint32_t cr4;
+      asm volatile ("movl %%cr4, %0" : "=r" (cr4));
+      asm volatile ("movl %0, %%cr4" : : "r" (cr4 | CR4_PSE));
+    }
+
   /* Store the physical address of the page directory into CR3
      aka PDBR (page directory base register).  This activates our
      new page tables immediately.  See [IA32-v2a] "MOV--Move
@@ -295,6 +365,8 @@ parse_options (char **argv)
 #ifdef VM
       else if (!strcmp (name, "-swap"))
         swap_bdev_name = value;
+      else if (!strcmp (name, "-wsclock"))
+        swap_wsclock = true;
 #endif
 #endif
       else if (!strcmp (name, "-rs"))
@@ -420,6 +492,7 @@ usage (void)
           "  -scratch=BDEV      Use BDEV for scratch instead of default.\n"
 #ifdef VM
           "  -swap=BDEV         Use BDEV for swap instead of default.\n"
+          "  -wsclock           Use WSClock page replacement.\n"
 #endif
 #endif
           "  -rs=SEED           Set random number seed to SEED.\n"
@@ -10,6 +10,11 @@
 /* Page directory with kernel mappings only. */
 extern uint32_t *base_page_dir;
 
+/* True if the CPU supports 4 MB pages (PSE).  They then map most
+   of the kernel's view of physical memory, and user regions that
+   ask for them with madvise(). */
+extern bool paging_large_pages;
+
 /* -q: Power off when kernel tasks complete? */
 extern bool power_off_when_done;
 
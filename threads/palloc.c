@@ -8,6 +8,7 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include "threads/interrupt.h"
 #include "threads/loader.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
@@ -24,7 +25,15 @@
 
    By default, half of system RAM is given to the kernel pool and
    half to the user pool.  That should be huge overkill for the
-   kernel pool, but that's just fine for demonstration purposes. */
+   kernel pool, but that's just fine for demonstration purposes.
+
+   Each pool also keeps up to ZERO_CACHE free pages that the idle
+   thread has already zeroed.  They are marked used in the bitmap
+   and handed out first to single-page PAL_ZERO requests, so that
+   page faults and thread creation rarely pay for a memset().
+   When the bitmap runs dry, any request may take one. */
+
+#define ZERO_CACHE 32
 
 /* A memory pool. */
 struct pool
@@ -32,6 +41,8 @@ struct pool
     struct lock lock;                   /* Mutual exclusion. */
     struct bitmap *used_map;            /* Bitmap of free pages. */
     uint8_t *base;                      /* Base of pool. */
+    void *zeroed[ZERO_CACHE];           /* Zeroed pages, if any. */
+    size_t zeroed_cnt;                  /* Number of zeroed pages. */
   };
 
 /* Two pools: one for kernel data, one for user pages. */
@@ -40,9 +51,15 @@ struct pool kernel_pool, user_pool;
 /* Maximum number of pages to put in user pool. */
 size_t user_page_limit = SIZE_MAX;
 
+/* A kernel page of zeros.  The VM maps it read-only at user pages
+   that have not been written yet. */
+void *zero_page;
+
 static void init_pool (struct pool *, void *base, size_t page_cnt,
                        const char *name);
 static bool page_from_pool (const struct pool *, void *page);
+static void *zeroed_pop (struct pool *);
+static bool zeroed_fill (struct pool *);
 
 /* Initializes the page allocator. */
 void
@@ -63,6 +80,8 @@ palloc_init (void)
   init_pool (&kernel_pool, free_start, kernel_pages, "kernel pool");
   init_pool (&user_pool, free_start + kernel_pages * PGSIZE,
              user_pages, "user pool");
+
+  zero_page = palloc_get_page (PAL_ASSERT | PAL_ZERO);
 }
 
 /* Obtains and returns a group of PAGE_CNT contiguous free pages.
@@ -81,12 +100,21 @@ palloc_get_multiple (enum palloc_flags flags, size_t page_cnt)
   if (page_cnt == 0)
     return NULL;
 
+  if (page_cnt == 1 && (flags & PAL_ZERO))
+    {
+      pages = zeroed_pop (pool);
+      if (pages != NULL)
+        return pages;
+    }
+
   lock_acquire (&pool->lock);
   page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt, false);
   lock_release (&pool->lock);
 
   if (page_idx != BITMAP_ERROR)
     pages = pool->base + PGSIZE * page_idx;
+  else if (page_cnt == 1)
+    pages = zeroed_pop (pool);
   else
     pages = NULL;
 
@@ -104,6 +132,42 @@ palloc_get_multiple (enum palloc_flags flags, size_t page_cnt)
   return pages;
 }
 
+/* Like palloc_get_multiple(), but the pages' physical address
+   is also a multiple of PAGE_CNT pages, which must be a power of
+   two.  A 4 MB page mapping needs such a run. */
+void *
+palloc_get_aligned (enum palloc_flags flags, size_t page_cnt) 
+{
+  struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
+  size_t align = page_cnt * PGSIZE;
+  size_t cnt = bitmap_size (pool->used_map);
+  size_t page_idx;
+  void *pages = NULL;
+
+  ASSERT (page_cnt > 0 && (page_cnt & (page_cnt - 1)) == 0);
+
+  lock_acquire (&pool->lock);
+  for (page_idx = (ROUND_UP (vtop (pool->base), align) - vtop (pool->base))
+                  / PGSIZE;
+       page_idx + page_cnt <= cnt; page_idx += page_cnt)
+    if (bitmap_none (pool->used_map, page_idx, page_cnt)) 
+      {
+        bitmap_set_multiple (pool->used_map, page_idx, page_cnt, true);
+        pages = pool->base + PGSIZE * page_idx;
+        break;
+      }
+  lock_release (&pool->lock);
+
+  if (pages != NULL) 
+    {
+      if (flags & PAL_ZERO)
+        memset (pages, 0, PGSIZE * page_cnt);
+    }
+  else if (flags & PAL_ASSERT)
+    PANIC ("palloc_get: out of pages");
+  return pages;
+}
+
 /* Obtains a single free page and returns its kernel virtual
    address.
    If PAL_USER is set, the page is obtained from the user pool,
@@ -117,6 +181,55 @@ palloc_get_page (enum palloc_flags flags)
   return palloc_get_multiple (flags, 1);
 }
 
+/* Returns the number of pages in the user pool. */
+size_t
+palloc_user_page_cnt (void) 
+{
+  return bitmap_size (user_pool.used_map);
+}
+
+/* Returns the number of pages in the kernel pool. */
+size_t
+palloc_kernel_page_cnt (void) 
+{
+  return bitmap_size (kernel_pool.used_map);
+}
+
+/* Returns the index of PAGE within the kernel pool, or SIZE_MAX
+   if PAGE is not a kernel pool page.  See
+   palloc_user_page_idx(). */
+size_t
+palloc_kernel_page_idx (const void *page) 
+{
+  if (!page_from_pool (&kernel_pool, (void *) page))
+    return SIZE_MAX;
+  return pg_no (page) - pg_no (kernel_pool.base);
+}
+
+/* Returns the number of free pages in the user pool. */
+size_t
+palloc_user_free_cnt (void) 
+{
+  size_t cnt;
+
+  lock_acquire (&user_pool.lock);
+  cnt = bitmap_count (user_pool.used_map, 0,
+                      bitmap_size (user_pool.used_map), false);
+  lock_release (&user_pool.lock);
+  return cnt + user_pool.zeroed_cnt;
+}
+
+/* Returns the index of PAGE within the user pool, so that
+   per-page data for user pages can be kept in an array, or
+   SIZE_MAX if PAGE is not a user pool page. */
+size_t
+palloc_user_page_idx (const void *page) 
+{
+  if (!page_from_pool (&user_pool, (void *) page))
+    return SIZE_MAX;
+  return pg_no (page) - pg_no (user_pool.base);
+}
+
 /* Frees the PAGE_CNT pages starting at PAGES. */
 void
 palloc_free_multiple (void *pages, size_t page_cnt) 
@@ -152,6 +265,54 @@ palloc_free_page (void *page)
   palloc_free_multiple (page, 1);
 }
 
+/* Zeroes one free page ahead of time, if a pool has fewer than
+   ZERO_CACHE zeroed pages and a free page can be had without
+   waiting.  Returns true if it did.  Called by the idle thread,
+   with interrupts on; never blocks. */
+bool
+palloc_idle (void) 
+{
+  return zeroed_fill (&user_pool) || zeroed_fill (&kernel_pool);
+}
+
+/* Takes a page from POOL's zeroed pages.  Returns a null pointer
+   if there is none. */
+static void *
+zeroed_pop (struct pool *pool) 
+{
+  enum intr_level old_level = intr_disable ();
+  void *page = pool->zeroed_cnt > 0 ? pool->zeroed[--pool->zeroed_cnt] : NULL;
+  intr_set_level (old_level);
+  return page;
+}
+
+/* Adds one free page to POOL's zeroed pages, if there is room
+   and a free page, and POOL's lock is not held.  Returns true if
+   a page was added.  Only the idle thread adds zeroed pages, so
+   room cannot vanish while the page is being zeroed. */
+static bool
+zeroed_fill (struct pool *pool) 
+{
+  enum intr_level old_level;
+  size_t page_idx;
+  void *page;
+
+  if (pool->zeroed_cnt >= ZERO_CACHE || !lock_try_acquire (&pool->lock))
+    return false;
+  page_idx = bitmap_scan_and_flip (pool->used_map, 0, 1, false);
+  lock_release (&pool->lock);
+  if (page_idx == BITMAP_ERROR)
+    return false;
+
+  page = pool->base + PGSIZE * page_idx;
+  memset (page, 0, PGSIZE);
+
+  old_level = intr_disable ();
+  pool->zeroed[pool->zeroed_cnt++] = page;
+  intr_set_level (old_level);
+  return true;
+}
+
 /* Initializes pool P as starting at START and ending at END,
    naming it NAME for debugging purposes. */
 static void
@@ -169,6 +330,7 @@ init_pool (struct pool *p, void *base, size_t page_cnt, const char *name)
 
   /* Initialize the pool. */
   lock_init (&p->lock);
+  p->zeroed_cnt = 0;
   p->used_map = bitmap_create_in_buf (page_cnt, base, bm_pages * PGSIZE);
   p->base = base + bm_pages * PGSIZE;
 }
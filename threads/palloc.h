@@ -2,6 +2,7 @@
 //3007
 #define THREADS_PALLOC_H
 
+#include <stdbool.h>
 #include <stddef.h>
 
 /* How to allocate pages. */
@@ -21,7 +22,14 @@ extern void* zero_page;
 void palloc_init (void);
 void *palloc_get_page (enum palloc_flags);
 void *palloc_get_multiple (enum palloc_flags, size_t page_cnt);
+void *palloc_get_aligned (enum palloc_flags, size_t page_cnt);
 void palloc_free_page (void *);
 void palloc_free_multiple (void *, size_t page_cnt);
+bool palloc_idle (void);
+size_t palloc_user_page_cnt (void);
+size_t palloc_user_free_cnt (void);
+size_t palloc_user_page_idx (const void *);
+size_t palloc_kernel_page_cnt (void);
+size_t palloc_kernel_page_idx (const void *);
 
 #endif /* threads/palloc.h */
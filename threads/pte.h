@@ -77,8 +77,17 @@ static inline uintptr_t pd_no (const void *va) {
 #define PTE_CD (1 << 4)         /* 1=cache disabled, 0=cache enabled. */
 #define PTE_A 0x20              /* 1=accessed, 0=not acccessed. */
 #define PTE_D 0x40              /* 1=dirty, 0=not dirty (PTEs only). */
+#define PTE_PS (1 << 7)         /* 1=4 MB page (PDEs only, with PSE). */
 #define PTE_G (1 << 8)          /* 1=global page, do not flush */
 
+/* A PDE with PTE_PS set maps a whole 4 MB page itself.  Its
+   flags are those of a PTE; its address must be a multiple of
+   4 MB. */
+#define PDE_LARGE_ADDR 0xffc00000       /* Address bits of a 4 MB page. */
+#define LARGE_PGSIZE PTSPAN             /* Bytes in a 4 MB page. */
+#define LARGE_PG_CNT (LARGE_PGSIZE / PGSIZE) /* Pages in a 4 MB page. */
+#define CR4_PSE (1 << 4)                /* CR4 bit enabling PTE_PS. */
+
 /* Returns a PDE that points to page table PT. */
 static inline uint32_t pde_create_user (uint32_t *pt) {
   ASSERT (pg_ofs (pt) == 0);
@@ -91,10 +100,31 @@ static inline uint32_t pde_create_kernel (uint32_t *pt) {
   return vtop (pt) | PTE_P | PTE_W | PTE_G;
 }
 
+/* Returns a PDE that maps the 4 MB page PAGE for ring 0 code
+   only. */
+static inline uint32_t pde_create_kernel_large (void *page) {
+  ASSERT (vtop (page) % LARGE_PGSIZE == 0);
+  return vtop (page) | PTE_P | PTE_W | PTE_G | PTE_PS;
+}
+
+/* Returns a PDE that maps the 4 MB page PAGE for user and
+   kernel code, writable if WRITABLE is true. */
+static inline uint32_t pde_create_user_large (void *page, bool writable) {
+  ASSERT (vtop (page) % LARGE_PGSIZE == 0);
+  return vtop (page) | PTE_P | (writable ? PTE_W : 0) | PTE_U | PTE_PS;
+}
+
+/* Returns a pointer to the 4 MB page that PDE maps. */
+static inline void *pde_get_large_page (uint32_t pde) {
+  ASSERT (pde & PTE_PS);
+  return ptov (pde & PDE_LARGE_ADDR);
+}
+
 /* Returns a pointer to the page table that page directory entry
    PDE, which must "present", points to. */
 static inline uint32_t *pde_get_pt (uint32_t pde) {
   ASSERT (pde & PTE_P);
+  ASSERT (!(pde & PTE_PS));
   return ptov (pde & PTE_ADDR);
 }
 
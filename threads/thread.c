@@ -17,8 +17,12 @@
 #include "filesys/directory.h"
 //////////////////////////////////////////////////////////////////
 #ifdef USERPROG
+#include "userprog/pagedir.h"
 #include "userprog/process.h"
 #endif
+#ifdef VM
+#include "vm/page.h"
+#endif
 
 /* Random value for struct thread's `magic' member.
    Used to detect stack overflow.  See the big comment at the top
@@ -203,6 +207,10 @@ thread_create (const char *name, int priority,
   t->parent_tid = thread_current()->tid;
   ////////////////////////////////////////////////////////////////////////////////////
   t->cwd = thread_current()->cwd;  
+#ifdef VM
+  // like the working directory, the stack limit is inherited
+  t->stack_limit = thread_current ()->stack_limit;
+#endif
   ////////////////////////////////////////////////////////////////////////////////////  
   if(thread_current()->tid != 1)
     t->parent_waiting_exec = thread_current();
@@ -435,6 +443,17 @@ idle (void *idle_started_ UNUSED)
 
   for (;;) 
     {
+      /* Nothing else to run: zero free pages ahead of time, one
+         at a time, until some thread becomes ready. */
+      while (list_empty (&ready_list)
+#ifdef USERPROG
+             && (pagedir_idle () || palloc_idle ())
+#else
+             && palloc_idle ()
+#endif
+             )
+        continue;
+
       /* Let someone else run. */
       intr_disable ();
       thread_block ();
@@ -504,6 +523,12 @@ init_thread (struct thread *t, const char *name, int priority)
   t->magic = THREAD_MAGIC;
   t->parent_waiting = 0;
   t->exec_status = -1;
+#ifdef USERPROG
+  list_init (&t->aio_list);
+#endif
+#ifdef VM
+  t->stack_limit = STACK_LIMIT_DEFAULT;
+#endif
   list_push_back (&all_list, &t->allelem);
 }
 
@@ -3,6 +3,7 @@
 #define THREADS_THREAD_H
 
 #include <debug.h>
+#include <hash.h>
 #include <list.h>
 #include <stdint.h>
 #include "threads/synch.h"
@@ -39,8 +40,6 @@ struct zombie_thread
 
 extern struct lock filesys_lock;
 
-#define FDTABLESIZE 128
-
 int zombie_free(tid_t tid, uint32_t* exit_status, struct thread** p_child_t);
 struct thread* get_thread_from_tid(tid_t tid);
 void print_system_state(void);
@@ -117,8 +116,22 @@ struct thread
 #ifdef USERPROG
     /* Owned by userprog/process.c. */
     uint32_t *pagedir;                  /* Page directory. */
-    struct file* fd_table[FDTABLESIZE]; //  fixed size file descriptor table
+    struct fd_table *fds;               //  growable file descriptor table
+    struct ring_sq *ring_sq;            //  shared submission ring, kernel address
+    struct ring_cq *ring_cq;            //  shared completion ring, kernel address
+    struct list aio_list;               //  outstanding asynchronous I/O requests
+    int aio_next_id;                    //  id for the next aio request
     struct file* fi;                    //  executables file pointer
+#endif
+#ifdef VM
+    struct hash shadow_pg_tbl;          //  supplemental (shadow) page table
+    struct list vma_list;               //  program segments and mmaps, by address
+    struct hash map_tbl;                //  memory mapped files, by mapid
+    int map_next_id;                    //  mapid for the next mmap()
+    void *esp;                          //  user stack pointer at syscall entry
+    size_t stack_limit;                 //  most bytes the user stack may use
+    uint8_t *heap_start;                //  start of the heap, after the program
+    uint8_t *heap_end;                  //  current break, set with sbrk()
 #endif
     uint32_t exit_status;               // exit status of the process
     tid_t parent_tid;                   // tid of its parent 
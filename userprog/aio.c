@@ -0,0 +1,229 @@
+#include "userprog/aio.h"
+#include <debug.h>
+#include <list.h>
+#include "filesys/file.h"
+#include "filesys/inode.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "userprog/fdtable.h"
+#include "userprog/syscall.h"
+
+/* Asynchronous file I/O.
+
+   aio_read() and aio_write() queue a request and return at once
+   with a request id; a pool of AIO_WORKERS kernel threads takes
+   requests off the queue and performs them, and aio_wait()
+   blocks until a given request is done and collects its result.
+   A process can thus keep several disk requests in flight while
+   it goes on computing.
+
+   Workers run outside the requesting process's address space, so
+   every request carries a kernel bounce buffer: write data is
+   copied in at submission, read data is copied out to the user
+   buffer by aio_wait() in the process's own context.  Each
+   request also holds its own reopened `struct file', so closing
+   the descriptor early cannot pull the file out from under a
+   worker, and uses an explicit file offset, so requests do not
+   race on the shared file position. */
+
+struct aio_request
+  {
+    int id;                             /* Id handed back to the process. */
+    bool write;                         /* Write if true, read if false. */
+    struct file *file;                  /* Private reopened file. */
+    off_t offset;                       /* File offset. */
+    off_t size;                         /* Bytes to transfer. */
+    void *ubuf;                         /* User buffer. */
+    void *kbuf;                         /* Kernel bounce buffer. */
+    int result;                         /* Bytes transferred, or -1. */
+    struct semaphore done;              /* Upped by the worker when done. */
+    struct list_elem queue_elem;        /* Element in aio_queue. */
+    struct list_elem proc_elem;         /* Element in owner's aio_list. */
+  };
+
+static struct list aio_queue;           /* Requests waiting for a worker. */
+static struct lock aio_lock;            /* Protects aio_queue. */
+static struct condition aio_ready;      /* Signalled when aio_queue grows. */
+
+static thread_func aio_worker NO_RETURN;
+static struct aio_request *aio_find (int id);
+static void aio_free (struct aio_request *);
+
+// sets up the request queue and starts the worker threads
+void
+aio_init (void)
+{
+  int i;
+
+  list_init (&aio_queue);
+  lock_init (&aio_lock);
+  cond_init (&aio_ready);
+
+  for (i = 0; i < AIO_WORKERS; i++)
+    if (thread_create ("aio_worker", PRI_DEFAULT, aio_worker, NULL)
+        == TID_ERROR)
+      PANIC ("aio_init: cannot start worker thread");
+}
+
+// queues a read (or write, if WRITE) of SIZE bytes at OFFSET of
+// file FD to (from) BUFFER.
+// returns the request id, or -1 if FD is not an open file, the
+// request is too large, or the process has too many outstanding;
+// terminates the process if a write's BUFFER is not readable
+int
+aio_submit (int fd, void *buffer, unsigned size, unsigned offset, bool write)
+{
+  struct thread *t = thread_current ();
+  struct aio_request *r;
+  struct file *fi = fd_get (t->fds, fd);
+
+  if (fi == NULL || size > AIO_MAX_SIZE || (off_t) offset < 0
+      || list_size (&t->aio_list) >= AIO_MAX_PENDING)
+    return -1;
+
+  r = calloc (1, sizeof *r);
+  if (r == NULL)
+    return -1;
+  r->kbuf = malloc (size > 0 ? size : 1);
+  if (r->kbuf == NULL)
+    {
+      free (r);
+      return -1;
+    }
+  if (write && !user_copy_in (r->kbuf, buffer, size))
+    {
+      free (r->kbuf);
+      free (r);
+      t->exit_status = -1;
+      process_terminate ();
+    }
+
+  lock_acquire (&filesys_lock);
+  if (!inode_get_status (file_get_inode (fi)))  // no I/O on directories
+    r->file = file_reopen (fi);
+  lock_release (&filesys_lock);
+  if (r->file == NULL)
+    {
+      free (r->kbuf);
+      free (r);
+      return -1;
+    }
+
+  r->id = t->aio_next_id++;
+  r->write = write;
+  r->offset = offset;
+  r->size = size;
+  r->ubuf = buffer;
+  r->result = -1;
+  sema_init (&r->done, 0);
+  list_push_back (&t->aio_list, &r->proc_elem);
+
+  lock_acquire (&aio_lock);
+  list_push_back (&aio_queue, &r->queue_elem);
+  cond_signal (&aio_ready, &aio_lock);
+  lock_release (&aio_lock);
+
+  return r->id;
+}
+
+// blocks until request ID of the current process completes,
+// copies read data out to the user buffer, and returns the
+// number of bytes transferred; -1 if ID is not outstanding.
+// terminates the process if the buffer is not writable
+int
+aio_wait (int id)
+{
+  struct aio_request *r = aio_find (id);
+  int result;
+
+  if (r == NULL)
+    return -1;
+
+  sema_down (&r->done);
+  result = r->result;
+  if (!r->write && result > 0)
+    {
+      if (!user_copy_out (r->ubuf, r->kbuf, result))
+        {
+          aio_free (r);
+          thread_current ()->exit_status = -1;
+          process_terminate ();
+        }
+    }
+
+  aio_free (r);
+  return result;
+}
+
+// waits for and discards every outstanding request of the
+// current process; called when the process exits
+void
+aio_cleanup (void)
+{
+  struct thread *t = thread_current ();
+
+  while (!list_empty (&t->aio_list))
+    {
+      struct aio_request *r = list_entry (list_front (&t->aio_list),
+                                          struct aio_request, proc_elem);
+      sema_down (&r->done);
+      aio_free (r);
+    }
+}
+
+// worker thread: performs queued requests forever
+static void
+aio_worker (void *aux UNUSED)
+{
+  for (;;)
+    {
+      struct aio_request *r;
+
+      lock_acquire (&aio_lock);
+      while (list_empty (&aio_queue))
+        cond_wait (&aio_ready, &aio_lock);
+      r = list_entry (list_pop_front (&aio_queue),
+                      struct aio_request, queue_elem);
+      lock_release (&aio_lock);
+
+      lock_acquire (&filesys_lock);
+      if (r->write)
+        r->result = file_write_at (r->file, r->kbuf, r->size, r->offset);
+      else
+        r->result = file_read_at (r->file, r->kbuf, r->size, r->offset);
+      lock_release (&filesys_lock);
+
+      sema_up (&r->done);
+    }
+}
+
+// returns the outstanding request ID of the current process,
+// or NULL if there is none
+static struct aio_request *
+aio_find (int id)
+{
+  struct thread *t = thread_current ();
+  struct list_elem *e;
+
+  for (e = list_begin (&t->aio_list); e != list_end (&t->aio_list);
+       e = list_next (e))
+    {
+      struct aio_request *r = list_entry (e, struct aio_request, proc_elem);
+      if (r->id == id)
+        return r;
+    }
+  return NULL;
+}
+
+// releases a completed request
+static void
+aio_free (struct aio_request *r)
+{
+  list_remove (&r->proc_elem);
+  lock_acquire (&filesys_lock);
+  file_close (r->file);
+  lock_release (&filesys_lock);
+  free (r->kbuf);
+  free (r);
+}
@@ -0,0 +1,20 @@
+#ifndef USERPROG_AIO_H
+#define USERPROG_AIO_H
+
+#include <stdbool.h>
+
+/* Number of kernel threads that carry out asynchronous I/O. */
+#define AIO_WORKERS 4
+
+/* Most requests a process may have outstanding at once, and the
+   largest single request, in bytes. */
+#define AIO_MAX_PENDING 32
+#define AIO_MAX_SIZE (64 * 1024)
+
+void aio_init (void);
+int aio_submit (int fd, void *buffer, unsigned size, unsigned offset,
+                bool write);
+int aio_wait (int id);
+void aio_cleanup (void);
+
+#endif /* userprog/aio.h */
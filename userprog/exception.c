@@ -7,6 +7,10 @@
 #include "threads/thread.h"
 #include "threads/vaddr.h"
 #include "userprog/syscall.h"
+#ifdef VM
+#include "vm/frame.h"
+#include "vm/page.h"
+#endif
 
 /* Number of page faults processed. */
 static long long page_fault_cnt;
@@ -151,6 +155,42 @@ page_fault (struct intr_frame *f)
   write = (f->error_code & PF_W) != 0;
   user = (f->error_code & PF_U) != 0;
 
+#ifdef VM
+  // bring in the page from wherever it lives, or grow the stack;
+  // during a syscall the user esp was saved at entry
+  struct thread *cur = thread_current ();
+  if(not_present && cur->pagedir != NULL && fault_addr != NULL
+     && is_user_vaddr(fault_addr))
+  {
+    void *upage = pg_round_down(fault_addr);
+    void *esp = user ? f->esp : cur->esp;
+    struct shadow_elem *s = page_lookup(upage);
+    if(s != NULL)
+    {
+      if(demand_page(s))
+        return;
+    }
+    else if(is_valid_stack_access(fault_addr, esp) && grow_stack(fault_addr, write))
+      return;
+  }
+
+  // first write to a page shared copy-on-write since fork(),
+  // or to a page still mapping the zero page
+  if(!not_present && write && cur->pagedir != NULL
+     && is_user_vaddr(fault_addr) && frame_cow_fault(pg_round_down(fault_addr)))
+    return;
+#endif
+
+  // a kernel access to user memory through get_user() or
+  // put_user() faulted: resume after the access, returning -1.
+  // Any other kernel fault is a bug and is not resumed
+  if(!user && is_user_vaddr(fault_addr) && user_access_insn((void *) f->eip))
+  {
+    f->eip = (void (*) (void)) f->eax;
+    f->eax = 0xffffffff;
+    return;
+  }
+
   // terminate the process if pagefault
   struct thread *t = thread_current ();
   t->exit_status = -1;
@@ -0,0 +1,192 @@
+#include "userprog/fdtable.h"
+#include <bitmap.h>
+#include <debug.h>
+#include <string.h>
+#include "filesys/file.h"
+#include "threads/malloc.h"
+
+static bool fd_table_grow (struct fd_table *);
+
+/* Creates an empty descriptor table with descriptors 0 and 1
+   reserved for the console.  Returns a null pointer if memory
+   allocation fails. */
+struct fd_table *
+fd_table_create (void)
+{
+  struct fd_table *ft = malloc (sizeof *ft);
+  if (ft == NULL)
+    return NULL;
+
+  ft->files = calloc (FD_TABLE_INIT, sizeof *ft->files);
+  ft->used = bitmap_create (FD_TABLE_INIT);
+  if (ft->files == NULL || ft->used == NULL)
+    {
+      free (ft->files);
+      if (ft->used != NULL)
+        bitmap_destroy (ft->used);
+      free (ft);
+      return NULL;
+    }
+  ft->size = FD_TABLE_INIT;
+
+  // STDIN and STDOUT are never handed out
+  bitmap_set_multiple (ft->used, 0, 2, true);
+  ft->next_free = 2;
+  return ft;
+}
+
+/* Creates a copy of FT for a forked child: every open file is
+   reopened under the same descriptor, at the same position.
+   Returns a null pointer if memory allocation fails.
+   The caller must hold filesys_lock. */
+struct fd_table *
+fd_table_dup (struct fd_table *ft)
+{
+  struct fd_table *copy;
+  size_t fd;
+
+  ASSERT (ft != NULL);
+
+  copy = malloc (sizeof *copy);
+  if (copy == NULL)
+    return NULL;
+  copy->files = calloc (ft->size, sizeof *copy->files);
+  copy->used = bitmap_create (ft->size);
+  if (copy->files == NULL || copy->used == NULL)
+    {
+      free (copy->files);
+      if (copy->used != NULL)
+        bitmap_destroy (copy->used);
+      free (copy);
+      return NULL;
+    }
+  copy->size = ft->size;
+  copy->next_free = ft->next_free;
+  bitmap_set_multiple (copy->used, 0, 2, true);
+
+  for (fd = 2; fd < ft->size; fd++)
+    if (ft->files[fd] != NULL)
+      {
+        struct file *file = file_reopen (ft->files[fd]);
+        if (file == NULL)
+          {
+            fd_table_destroy (copy);
+            return NULL;
+          }
+        file_seek (file, file_tell (ft->files[fd]));
+        copy->files[fd] = file;
+        bitmap_mark (copy->used, fd);
+      }
+  return copy;
+}
+
+/* Closes every file still open in FT and frees FT.
+   The caller must hold filesys_lock. */
+void
+fd_table_destroy (struct fd_table *ft)
+{
+  size_t fd;
+
+  if (ft == NULL)
+    return;
+
+  for (fd = 2; fd < ft->size; fd++)
+    if (ft->files[fd] != NULL)
+      file_close (ft->files[fd]);
+
+  free (ft->files);
+  bitmap_destroy (ft->used);
+  free (ft);
+}
+
+/* Installs FILE in the lowest free descriptor of FT, growing the
+   table if every descriptor is taken.  Returns the descriptor,
+   or -1 if the table is at FD_TABLE_MAX or cannot grow. */
+int
+fd_alloc (struct fd_table *ft, struct file *file)
+{
+  size_t fd;
+
+  ASSERT (ft != NULL);
+  ASSERT (file != NULL);
+
+  // nothing below next_free is free, so the scan usually
+  // stops at its first bit
+  fd = bitmap_scan_and_flip (ft->used, ft->next_free, 1, false);
+  if (fd == BITMAP_ERROR)
+    {
+      fd = ft->size;
+      if (!fd_table_grow (ft))
+        return -1;
+      bitmap_mark (ft->used, fd);
+    }
+
+  ft->files[fd] = file;
+  ft->next_free = fd + 1;
+  return fd;
+}
+
+/* Returns the file open as descriptor FD in FT, or a null
+   pointer if FD is not an open descriptor. */
+struct file *
+fd_get (struct fd_table *ft, int fd)
+{
+  if (ft == NULL || fd < 0 || (size_t) fd >= ft->size)
+    return NULL;
+  return ft->files[fd];
+}
+
+/* Releases descriptor FD of FT and returns the file that was
+   open on it, or a null pointer if FD was not open.  Closing the
+   file is left to the caller. */
+struct file *
+fd_remove (struct fd_table *ft, int fd)
+{
+  struct file *file = fd_get (ft, fd);
+
+  if (file != NULL)
+    {
+      ft->files[fd] = NULL;
+      bitmap_reset (ft->used, fd);
+      if ((size_t) fd < ft->next_free)
+        ft->next_free = fd;
+    }
+  return file;
+}
+
+/* Doubles the number of slots in FT, up to FD_TABLE_MAX.
+   Returns true if successful, false if FT is already at its
+   maximum size or memory allocation fails. */
+static bool
+fd_table_grow (struct fd_table *ft)
+{
+  size_t new_size = ft->size * 2;
+  struct file **files;
+  struct bitmap *used;
+
+  if (ft->size >= FD_TABLE_MAX)
+    return false;
+  if (new_size > FD_TABLE_MAX)
+    new_size = FD_TABLE_MAX;
+
+  files = calloc (new_size, sizeof *files);
+  used = bitmap_create (new_size);
+  if (files == NULL || used == NULL)
+    {
+      free (files);
+      if (used != NULL)
+        bitmap_destroy (used);
+      return false;
+    }
+
+  // every old slot is in use, otherwise we would not be growing
+  memcpy (files, ft->files, ft->size * sizeof *files);
+  bitmap_set_multiple (used, 0, ft->size, true);
+
+  free (ft->files);
+  bitmap_destroy (ft->used);
+  ft->files = files;
+  ft->used = used;
+  ft->size = new_size;
+  return true;
+}
@@ -0,0 +1,32 @@
+#ifndef USERPROG_FDTABLE_H
+#define USERPROG_FDTABLE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+struct file;
+
+/* Initial and maximum number of descriptors in a process's
+   table.  The table doubles in size whenever it fills up. */
+#define FD_TABLE_INIT 16
+#define FD_TABLE_MAX 4096
+
+/* Per-process file descriptor table.  Lives on the kernel heap
+   rather than inside `struct thread', so it neither eats into
+   the kernel stack nor limits how many files can be open. */
+struct fd_table
+  {
+    struct file **files;        /* Open files, indexed by descriptor. */
+    struct bitmap *used;        /* One bit per descriptor, set if in use. */
+    size_t size;                /* Number of slots in FILES and USED. */
+    size_t next_free;           /* No descriptor below this is free. */
+  };
+
+struct fd_table *fd_table_create (void);
+struct fd_table *fd_table_dup (struct fd_table *);
+void fd_table_destroy (struct fd_table *);
+int fd_alloc (struct fd_table *, struct file *);
+struct file *fd_get (struct fd_table *, int fd);
+struct file *fd_remove (struct fd_table *, int fd);
+
+#endif /* userprog/fdtable.h */
@@ -0,0 +1,150 @@
+#include "userprog/ioring.h"
+#include <debug.h>
+#include <ring.h>
+#include <stdint.h>
+#include "threads/palloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+#include "userprog/syscall.h"
+#ifdef VM
+#include "vm/page.h"
+#endif
+
+/* Batched syscall submission.
+
+   A process that issues many small I/Os pays for a trap and for
+   argument validation on every one of them.  Instead it can map
+   a pair of rings (see lib/ring.h) with ring_setup(), queue any
+   number of requests in the submission ring, and have them all
+   carried out by a single ring_enter().  The ring pages come from
+   the user pool but are never evicted, so the kernel reads and
+   writes them through their kernel addresses without any user
+   pointer checks; only the buffers named by the requests are
+   copied with fault checks. */
+
+static int ring_do (const struct ring_sqe *);
+
+// maps the submission ring at UADDR and the completion ring in
+// the page right after it; UADDR must be page aligned and both
+// pages must be unmapped. A process has at most one ring.
+bool
+ring_setup (void *uaddr)
+{
+  struct thread *t = thread_current ();
+  uint8_t *upage = uaddr;
+  struct ring_sq *sq;
+  struct ring_cq *cq;
+
+  if (t->ring_sq != NULL)
+    return false;
+  if (upage == NULL || pg_ofs (upage) != 0 || !is_user_vaddr (upage)
+      || (uint8_t *) PHYS_BASE - upage < 2 * PGSIZE)
+    return false;
+  if (pagedir_get_page (t->pagedir, upage) != NULL
+      || pagedir_get_page (t->pagedir, upage + PGSIZE) != NULL)
+    return false;
+#ifdef VM
+  if (!mmap_range_free (upage, 2 * PGSIZE))
+    return false;
+#endif
+
+  // zeroed pages start out with empty rings
+  sq = palloc_get_page (PAL_USER | PAL_ZERO);
+  cq = palloc_get_page (PAL_USER | PAL_ZERO);
+  if (sq == NULL || cq == NULL)
+    goto fail;
+
+  if (!pagedir_set_page (t->pagedir, upage, sq, true))
+    goto fail;
+  if (!pagedir_set_page (t->pagedir, upage + PGSIZE, cq, true))
+    {
+      pagedir_clear_page (t->pagedir, upage);
+      goto fail;
+    }
+
+  // the pages are freed with the page directory at exit
+  t->ring_sq = sq;
+  t->ring_cq = cq;
+  return true;
+
+ fail:
+  if (sq != NULL)
+    palloc_free_page (sq);
+  if (cq != NULL)
+    palloc_free_page (cq);
+  return false;
+}
+
+// carries out up to TO_SUBMIT queued requests, posting a
+// completion for each; stops early when the submission ring is
+// empty or the completion ring is full.
+// returns the number of requests consumed, or -1 if the process
+// has no ring or the ring indexes are corrupt
+int
+ring_enter (unsigned to_submit)
+{
+  struct thread *t = thread_current ();
+  struct ring_sq *sq = t->ring_sq;
+  struct ring_cq *cq = t->ring_cq;
+  uint32_t head, tail, cq_tail;
+  int done = 0;
+
+  if (sq == NULL)
+    return -1;
+
+  // the process may change the ring under us at any time, so read
+  // each index once and trust nothing beyond a sanity check
+  head = sq->head;
+  tail = sq->tail;
+  cq_tail = cq->tail;
+  if (tail - head > RING_ENTRIES)
+    return -1;
+
+  while (head != tail && (unsigned) done < to_submit
+         && cq_tail - cq->head < RING_ENTRIES)
+    {
+      struct ring_sqe sqe = sq->entries[head % RING_ENTRIES];
+      struct ring_cqe *cqe = &cq->entries[cq_tail % RING_ENTRIES];
+
+      cqe->user_data = sqe.user_data;
+      cqe->res = ring_do (&sqe);
+
+      // publish progress after every request, so the process sees
+      // finished work even if a later request kills it
+      sq->head = ++head;
+      cq->tail = ++cq_tail;
+      done++;
+    }
+  return done;
+}
+
+// performs a single request, returning what the equivalent
+// syscall would; bad user pointers fail the request with -1
+// instead of terminating the process
+static int
+ring_do (const struct ring_sqe *sqe)
+{
+  char *buf = (char *) sqe->addr;
+
+  switch (sqe->op)
+    {
+    case RING_OP_NOP:
+      return 0;
+    case RING_OP_OPEN:
+      if (!user_string_add_range_check (buf))
+        return -1;
+      return sys_open (buf);
+    case RING_OP_CLOSE:
+      sys_close (sqe->fd);
+      return 0;
+    case RING_OP_READ:
+    case RING_OP_WRITE:
+      // both return -1 if a copy to or from buf faults
+      if (sqe->op == RING_OP_READ)
+        return sys_read (sqe->fd, buf, sqe->len);
+      return sys_write (sqe->fd, buf, sqe->len);
+    default:
+      return -1;
+    }
+}
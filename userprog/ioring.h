@@ -0,0 +1,9 @@
+#ifndef USERPROG_IORING_H
+#define USERPROG_IORING_H
+
+#include <stdbool.h>
+
+bool ring_setup (void *uaddr);
+int ring_enter (unsigned to_submit);
+
+#endif /* userprog/ioring.h */
@@ -4,11 +4,63 @@
 #include <stddef.h>
 #include <string.h>
 #include "threads/init.h"
+#include "threads/malloc.h"
+#include "threads/interrupt.h"
 #include "threads/pte.h"
 #include "threads/palloc.h"
+#include "threads/thread.h"
 
 static uint32_t *active_pd (void);
 static void invalidate_pagedir (uint32_t *);
+static void invalidate_page (uint32_t *, const void *);
+
+/* Deferred TLB invalidation.  Between pagedir_batch_begin() and
+   pagedir_batch_end(), the thread that began the batch only notes
+   the user pages whose entries it changes in the active page
+   directory, and invalidates them together at the end, or with
+   one full flush if there are more than TLB_BATCH.  That thread
+   must not touch those pages before the end.  Other threads
+   invalidate at once.  A context switch in between reloads CR3,
+   which flushes the TLB anyway. */
+#define TLB_BATCH 32
+static struct thread *batch_owner;      /* Thread deferring, if any. */
+static int batch_depth;                 /* Nesting of its batches. */
+static size_t batch_cnt;                /* Pages changed so far. */
+static const void *batch_pages[TLB_BATCH]; /* The first TLB_BATCH. */
+
+/* Recycled page tables and page directories.  Freed ones go on
+   PT_DIRTY; the idle thread zeroes them and moves them to
+   PT_CLEAN, so that a new page table usually needs no memset().
+   A page directory is overwritten by pagedir_create() anyway, so
+   it prefers a dirty page.  Both stacks are only touched with
+   interrupts off. */
+#define PT_CACHE 16
+static void *pt_dirty[PT_CACHE];
+static void *pt_clean[PT_CACHE];
+static size_t pt_dirty_cnt, pt_clean_cnt;
+
+/* Populated part of a page directory or page table: entries
+   [LO, HI) are the only ones that have ever been set since the
+   page was allocated.  Indexed by the page's kernel pool index. */
+struct pt_range
+  {
+    uint16_t lo, hi;
+  };
+static struct pt_range *pt_ranges;
+
+static void *pt_alloc (bool zero);
+static void pt_free (void *);
+static void pt_range_add (uint32_t *, uint32_t *entry);
+
+/* Sets up the bookkeeping for page directories and page tables.
+   Must be called after malloc_init(). */
+void
+pagedir_init (void) 
+{
+  pt_ranges = calloc (palloc_kernel_page_cnt (), sizeof *pt_ranges);
+  if (pt_ranges == NULL)
+    PANIC ("pagedir_init: out of memory");
+}
 
 /* Creates a new page directory that has mappings for kernel
    virtual addresses, but none for user virtual addresses.
@@ -17,35 +69,140 @@ static void invalidate_pagedir (uint32_t *);
 uint32_t *
 pagedir_create (void) 
 {
-  uint32_t *pd = palloc_get_page (0);
+  uint32_t *pd = pt_alloc (false);
   if (pd != NULL)
     memcpy (pd, base_page_dir, PGSIZE);
   return pd;
 }
 
 /* Destroys page directory PD, freeing all the pages it
-   references. */
+   references.  Only the populated range of PD and of each of its
+   page tables is visited. */
 void
 pagedir_destroy (uint32_t *pd) 
 {
+  struct pt_range *r;
   uint32_t *pde;
 
   if (pd == NULL)
     return;
 
   ASSERT (pd != base_page_dir);
-  for (pde = pd; pde < pd + pd_no (PHYS_BASE); pde++)
-    if (*pde & PTE_P) 
+  r = &pt_ranges[palloc_kernel_page_idx (pd)];
+  for (pde = pd + r->lo; pde < pd + r->hi; pde++)
+    if (*pde & PTE_PS)
+      palloc_free_multiple (pde_get_large_page (*pde), LARGE_PG_CNT);
+    else if (*pde & PTE_P) 
       {
         uint32_t *pt = pde_get_pt (*pde);
+        struct pt_range *pr = &pt_ranges[palloc_kernel_page_idx (pt)];
         uint32_t *pte;
         
-        for (pte = pt; pte < pt + PGSIZE / sizeof *pte; pte++)
-          if (*pte & PTE_P) 
+        for (pte = pt + pr->lo; pte < pt + pr->hi; pte++)
+          if ((*pte & PTE_P) && pte_get_page (*pte) != zero_page)
             palloc_free_page (pte_get_page (*pte));
-        palloc_free_page (pt);
+        pt_free (pt);
       }
-  palloc_free_page (pd);
+  pt_free (pd);
+}
+
+/* Returns a page for a page directory or page table, with an
+   empty populated range, zeroed if ZERO is true.  Returns a null
+   pointer if memory allocation fails. */
+static void *
+pt_alloc (bool zero) 
+{
+  enum intr_level old_level;
+  void *page = NULL;
+  bool clean = false;
+
+  old_level = intr_disable ();
+  if (zero && pt_clean_cnt > 0)
+    {
+      page = pt_clean[--pt_clean_cnt];
+      clean = true;
+    }
+  else if (pt_dirty_cnt > 0)
+    page = pt_dirty[--pt_dirty_cnt];
+  else if (pt_clean_cnt > 0)
+    {
+      page = pt_clean[--pt_clean_cnt];
+      clean = true;
+    }
+  intr_set_level (old_level);
+
+  if (page == NULL)
+    {
+      page = palloc_get_page (zero ? PAL_ZERO : 0);
+      if (page == NULL)
+        return NULL;
+      clean = zero;
+    }
+  if (zero && !clean)
+    memset (page, 0, PGSIZE);
+
+  pt_ranges[palloc_kernel_page_idx (page)].lo = 0;
+  pt_ranges[palloc_kernel_page_idx (page)].hi = 0;
+  return page;
+}
+
+/* Frees PAGE, a page directory or page table, keeping it for
+   reuse if there is room. */
+static void
+pt_free (void *page) 
+{
+  enum intr_level old_level = intr_disable ();
+  bool kept = pt_dirty_cnt < PT_CACHE;
+
+  if (kept)
+    pt_dirty[pt_dirty_cnt++] = page;
+  intr_set_level (old_level);
+  if (!kept)
+    palloc_free_page (page);
+}
+
+/* Widens the populated range of TABLE, a page directory or page
+   table, to include ENTRY. */
+static void
+pt_range_add (uint32_t *table, uint32_t *entry) 
+{
+  struct pt_range *r = &pt_ranges[palloc_kernel_page_idx (table)];
+  uint16_t idx = entry - table;
+
+  if (r->lo == r->hi)
+    {
+      r->lo = idx;
+      r->hi = idx + 1;
+    }
+  else if (idx < r->lo)
+    r->lo = idx;
+  else if (idx >= r->hi)
+    r->hi = idx + 1;
+}
+
+/* Zeroes one freed page table for later reuse, if there is
+   one and room for it.  Returns true if it did.  Called by the
+   idle thread, with interrupts on.  Never blocks: only this
+   function adds to PT_CLEAN, so room there cannot vanish
+   meanwhile. */
+bool
+pagedir_idle (void) 
+{
+  enum intr_level old_level = intr_disable ();
+  void *page = NULL;
+
+  if (pt_dirty_cnt > 0 && pt_clean_cnt < PT_CACHE)
+    page = pt_dirty[--pt_dirty_cnt];
+  intr_set_level (old_level);
+  if (page == NULL)
+    return false;
+
+  memset (page, 0, PGSIZE);
+
+  old_level = intr_disable ();
+  pt_clean[pt_clean_cnt++] = page;
+  intr_set_level (old_level);
+  return true;
 }
 
 /* Returns the address of the page table entry for virtual
@@ -53,7 +210,9 @@ pagedir_destroy (uint32_t *pd)
    If PD does not have a page table for VADDR, behavior depends
    on CREATE.  If CREATE is true, then a new page table is
    created and a pointer into it is returned.  Otherwise, a null
-   pointer is returned. */
+   pointer is returned.
+   If VADDR lies in a 4 MB page, returns the PDE that maps it,
+   whose flags have the same meaning as a PTE's. */
 uint32_t *
 lookup_page (uint32_t *pd, const void *vaddr, bool create)
 {
@@ -71,15 +230,18 @@ lookup_page (uint32_t *pd, const void *vaddr, bool create)
     {
       if (create)
         {
-          pt = palloc_get_page (PAL_ZERO);
+          pt = pt_alloc (true);
           if (pt == NULL) 
             return NULL; 
       
           *pde = pde_create_user (pt);
+          pt_range_add (pd, pde);
         }
       else
         return NULL;
     }
+  if (*pde & PTE_PS)
+    return pde;
 
   /* Return the page table entry. */
   pt = pde_get_pt (*pde);
@@ -109,10 +271,11 @@ pagedir_set_page (uint32_t *pd, void *upage, void *kpage, bool writable)
 
   pte = lookup_page (pd, upage, true);
 
-  if (pte != NULL) 
+  if (pte != NULL && (*pte & PTE_PS) == 0) 
     {
       ASSERT ((*pte & PTE_P) == 0);
       *pte = pte_create_user (kpage, writable);
+      pt_range_add (pde_get_pt (pd[pd_no (upage)]), pte);
       return true;
     }
   else
@@ -131,10 +294,168 @@ pagedir_get_page (uint32_t *pd, const void *uaddr)
   ASSERT (is_user_vaddr (uaddr));
   
   pte = lookup_page (pd, uaddr, false);
-  if (pte != NULL && (*pte & PTE_P) != 0)
-    return pte_get_page (*pte) + pg_ofs (uaddr);
-  else
+  if (pte == NULL || (*pte & PTE_P) == 0)
     return NULL;
+  else if (*pte & PTE_PS)
+    return pde_get_large_page (*pte) + ((uintptr_t) uaddr & (LARGE_PGSIZE - 1));
+  else
+    return pte_get_page (*pte) + pg_ofs (uaddr);
+}
+
+/* Maps the 4 MB of user virtual memory at UPAGE, a multiple of
+   4 MB, in PD to the 4 MB page KPAGE with a single large page,
+   read/write if WRITABLE is true.  No page in the range may be
+   mapped; an empty page table there is freed.
+   Returns false if the CPU has no large pages or part of the
+   range is mapped. */
+bool
+pagedir_set_large_page (uint32_t *pd, void *upage, void *kpage,
+                        bool writable) 
+{
+  uint32_t *pde;
+
+  ASSERT ((uintptr_t) upage % LARGE_PGSIZE == 0);
+  ASSERT (is_user_vaddr (upage));
+  ASSERT (pd != base_page_dir);
+
+  if (!paging_large_pages)
+    return false;
+  pde = pd + pd_no (upage);
+  if (*pde & PTE_PS)
+    return false;
+  if (*pde & PTE_P) 
+    {
+      uint32_t *pt = pde_get_pt (*pde);
+      size_t i;
+
+      for (i = 0; i < PGSIZE / sizeof *pt; i++)
+        if (pt[i] & PTE_P)
+          return false;
+      *pde = 0;
+      invalidate_pagedir (pd);
+      pt_free (pt);
+    }
+  *pde = pde_create_user_large (kpage, writable);
+  pt_range_add (pd, pde);
+  return true;
+}
+
+/* Returns true if user virtual address UADDR lies in a 4 MB page
+   of PD. */
+bool
+pagedir_is_large (uint32_t *pd, const void *uaddr) 
+{
+  return (pd[pd_no (uaddr)] & (PTE_P | PTE_PS)) == (PTE_P | PTE_PS);
+}
+
+/* Unmaps the 4 MB page at UPAGE in PD, which must map one there,
+   and returns the kernel virtual address of its frames; the caller
+   frees them with palloc_free_multiple(). */
+void *
+pagedir_clear_large_page (uint32_t *pd, void *upage) 
+{
+  uint32_t *pde;
+  void *kpage;
+
+  ASSERT ((uintptr_t) upage % LARGE_PGSIZE == 0);
+  ASSERT (pagedir_is_large (pd, upage));
+
+  pde = pd + pd_no (upage);
+  kpage = pde_get_large_page (*pde);
+  *pde = 0;
+  invalidate_pagedir (pd);
+  return kpage;
+}
+
+/* Gives DST a private copy of every 4 MB user page mapped in SRC,
+   with the same access rights; DST maps nothing there yet.
+   Returns false if memory allocation failed, in which case DST
+   may be partially filled in; it is cleaned up by
+   pagedir_destroy(). */
+bool
+pagedir_dup_large (uint32_t *dst, uint32_t *src) 
+{
+  uint32_t *pde;
+
+  for (pde = src; pde < src + pd_no (PHYS_BASE); pde++)
+    if ((*pde & (PTE_P | PTE_PS)) == (PTE_P | PTE_PS)) 
+      {
+        void *kpage = palloc_get_aligned (PAL_USER, LARGE_PG_CNT);
+
+        if (kpage == NULL)
+          return false;
+        memcpy (kpage, pde_get_large_page (*pde), LARGE_PGSIZE);
+        dst[pde - src] = pde_create_user_large (kpage, (*pde & PTE_W) != 0);
+        pt_range_add (dst, &dst[pde - src]);
+      }
+  return true;
+}
+
+/* Returns true if user virtual page UPAGE is mapped writable
+   in PD, false if it is read-only or unmapped. */
+bool
+pagedir_is_writable (uint32_t *pd, const void *upage) 
+{
+  uint32_t *pte = lookup_page (pd, upage, false);
+  return pte != NULL && (*pte & PTE_P) != 0 && (*pte & PTE_W) != 0;
+}
+
+/* Makes the mapping of user virtual page UPAGE in PD writable
+   if WRITABLE is true, read-only otherwise.  Copy-on-write
+   sharing turns off write access this way, so that the first
+   write to the page faults.
+   UPAGE need not be mapped. */
+void
+pagedir_set_writable (uint32_t *pd, const void *upage, bool writable) 
+{
+  uint32_t *pte = lookup_page (pd, upage, false);
+  if (pte != NULL && (*pte & PTE_P) != 0) 
+    {
+      if (writable)
+        *pte |= PTE_W;
+      else 
+        {
+          *pte &= ~(uint32_t) PTE_W;
+          invalidate_page (pd, upage);
+        }
+    }
+}
+
+/* Gives DST a private copy of every user page mapped in SRC,
+   with the same access rights.  DST must not map any user pages
+   yet.  Returns true if successful, false if memory allocation
+   failed, in which case DST may be partially filled in; it is
+   cleaned up by pagedir_destroy(). */
+bool
+pagedir_dup (uint32_t *dst, uint32_t *src) 
+{
+  uint32_t *pde;
+
+  for (pde = src; pde < src + pd_no (PHYS_BASE); pde++)
+    if ((*pde & PTE_P) && !(*pde & PTE_PS)) 
+      {
+        uint32_t *pt = pde_get_pt (*pde);
+        size_t i;
+
+        for (i = 0; i < PGSIZE / sizeof *pt; i++)
+          if (pt[i] & PTE_P) 
+            {
+              void *upage = (void *) (((pde - src) << PDSHIFT)
+                                      | (i << PTSHIFT));
+              void *kpage = palloc_get_page (PAL_USER);
+
+              if (kpage == NULL)
+                return false;
+              memcpy (kpage, pte_get_page (pt[i]), PGSIZE);
+              if (!pagedir_set_page (dst, upage, kpage,
+                                     (pt[i] & PTE_W) != 0)) 
+                {
+                  palloc_free_page (kpage);
+                  return false;
+                }
+            }
+      }
+  return pagedir_dup_large (dst, src);
 }
 
 /* Marks user virtual page UPAGE "not present" in page
@@ -152,8 +473,9 @@ pagedir_clear_page (uint32_t *pd, void *upage)
   pte = lookup_page (pd, upage, false);
   if (pte != NULL && (*pte & PTE_P) != 0)
     {
+      ASSERT ((*pte & PTE_PS) == 0);
       *pte &= ~PTE_P;
-      invalidate_pagedir (pd);
+      invalidate_page (pd, upage);
     }
 }
 
@@ -181,7 +503,7 @@ pagedir_set_dirty (uint32_t *pd, const void *vpage, bool dirty)
       else 
         {
           *pte &= ~(uint32_t) PTE_D;
-          invalidate_pagedir (pd);
+          invalidate_page (pd, vpage);
         }
     }
 }
@@ -210,7 +532,7 @@ pagedir_set_accessed (uint32_t *pd, const void *vpage, bool accessed)
       else 
         {
           *pte &= ~(uint32_t) PTE_A; 
-          invalidate_pagedir (pd);
+          invalidate_page (pd, vpage);
         }
     }
 }
@@ -231,6 +553,47 @@ pagedir_activate (uint32_t *pd)
   asm volatile ("movl %0, %%cr3" : : "r" (vtop (pd)) : "memory");
 }
 
+/* Starts deferring TLB invalidation for the running thread, for
+   an operation that changes many entries, such as unmapping a
+   range or evicting a batch of pages.  Batches nest. */
+void
+pagedir_batch_begin (void) 
+{
+  enum intr_level old_level = intr_disable ();
+
+  if (batch_owner == NULL) 
+    {
+      batch_owner = thread_current ();
+      batch_cnt = 0;
+    }
+  if (batch_owner == thread_current ())
+    batch_depth++;
+  intr_set_level (old_level);
+}
+
+/* Ends a batch started by pagedir_batch_begin(); the outermost
+   end invalidates the pages changed during the batch. */
+void
+pagedir_batch_end (void) 
+{
+  enum intr_level old_level = intr_disable ();
+
+  if (batch_owner == thread_current () && --batch_depth == 0) 
+    {
+      if (batch_cnt > TLB_BATCH)
+        pagedir_activate (active_pd ());
+      else
+        {
+          size_t i;
+
+          for (i = 0; i < batch_cnt; i++)
+            asm volatile ("invlpg (%0)" : : "r" (batch_pages[i]) : "memory");
+        }
+      batch_owner = NULL;
+    }
+  intr_set_level (old_level);
+}
+
 /* Returns the currently active page directory. */
 static uint32_t *
 active_pd (void) 
@@ -251,7 +614,9 @@ active_pd (void)
 
    This function invalidates the TLB if PD is the active page
    directory.  (If PD is not active then its entries are not in
-   the TLB, so there is no need to invalidate anything.) */
+   the TLB, so there is no need to invalidate anything.)
+   Only needed when page tables themselves change; a change to a
+   single entry goes through invalidate_page(). */
 static void
 invalidate_pagedir (uint32_t *pd) 
 {
@@ -262,3 +627,23 @@ invalidate_pagedir (uint32_t *pd)
       pagedir_activate (pd);
     } 
 }
+
+/* Invalidates the TLB entry for VADDR, whose entry in PD changed,
+   leaving the rest of the TLB alone.  User entries are only in the
+   TLB if PD is active; kernel page tables are shared by every page
+   directory, so kernel entries always are.  See [IA32-v2a]
+   "INVLPG--Invalidate TLB Entry". */
+static void
+invalidate_page (uint32_t *pd, const void *vaddr) 
+{
+  if (is_user_vaddr (vaddr) && active_pd () != pd)
+    return;
+  if (is_user_vaddr (vaddr) && batch_owner == thread_current ())
+    {
+      if (batch_cnt < TLB_BATCH)
+        batch_pages[batch_cnt] = vaddr;
+      batch_cnt++;
+    }
+  else
+    asm volatile ("invlpg (%0)" : : "r" (vaddr) : "memory");
+}
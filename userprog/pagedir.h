@@ -5,16 +5,28 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+void pagedir_init (void);
 uint32_t *pagedir_create (void);
 void pagedir_destroy (uint32_t *pd);
 bool pagedir_set_page (uint32_t *pd, void *upage, void *kpage, bool rw);
 void *pagedir_get_page (uint32_t *pd, const void *upage);
+bool pagedir_set_large_page (uint32_t *pd, void *upage, void *kpage,
+                             bool writable);
+bool pagedir_is_large (uint32_t *pd, const void *uaddr);
+void *pagedir_clear_large_page (uint32_t *pd, void *upage);
+bool pagedir_dup_large (uint32_t *dst, uint32_t *src);
+bool pagedir_is_writable (uint32_t *pd, const void *upage);
+void pagedir_set_writable (uint32_t *pd, const void *upage, bool writable);
+bool pagedir_dup (uint32_t *dst, uint32_t *src);
 void pagedir_clear_page (uint32_t *pd, void *upage);
 bool pagedir_is_dirty (uint32_t *pd, const void *upage);
 void pagedir_set_dirty (uint32_t *pd, const void *upage, bool dirty);
 bool pagedir_is_accessed (uint32_t *pd, const void *upage);
 void pagedir_set_accessed (uint32_t *pd, const void *upage, bool accessed);
 void pagedir_activate (uint32_t *pd);
+void pagedir_batch_begin (void);
+void pagedir_batch_end (void);
+bool pagedir_idle (void);
 uint32_t *lookup_page (uint32_t *pd, const void *vaddr, bool create);
 
 #endif /* userprog/pagedir.h */
@@ -6,6 +6,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include "userprog/aio.h"
+#include "userprog/fdtable.h"
 #include "userprog/gdt.h"
 #include "userprog/pagedir.h"
 #include "userprog/tss.h"
@@ -15,14 +17,21 @@
 #include "threads/flags.h"
 #include "threads/init.h"
 #include "threads/interrupt.h"
+#include "threads/malloc.h"
 #include "threads/synch.h"
 #include "threads/palloc.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
 #include "devices/input.h"
+#ifdef VM
+#include "vm/frame.h"
+#include "vm/page.h"
+#endif
 #include "debug_helper.h"
 
 static thread_func start_process NO_RETURN;
+static thread_func start_fork NO_RETURN;
+static void exec_status_report (bool success);
 static bool load (const char *cmdline, void (**eip) (void), void **esp);
 void print_pagedir(uint32_t* pagedir);
 
@@ -104,25 +113,15 @@ start_process (void *file_name_)
        success = false;
   }
 
+  // file descriptor table, grows on demand as files are opened
   if(success)
-    thread_current()->exec_status = thread_current()->tid;
-  else
   {
-    thread_current()->exec_status = -1;
-    thread_current()->exit_status = -1;
+    t->fds = fd_table_create();
+    if(!t->fds)
+      success = false;
   }
 
-  // if parent is waiting for the exec_status
-  // then unblock it, and block itself, so that
-  // parent can collect the status. As child may
-  // die, without parent collecting the exec_status
-  if(thread_current()->parent_waiting_exec) 
-  {
-    thread_unblock(thread_current()->parent_waiting_exec);
-    intr_disable();
-    thread_block();
-    intr_enable();
-  }
+  exec_status_report(success);
   
   if(!success)
   {
@@ -132,12 +131,6 @@ start_process (void *file_name_)
     thread_exit ();
   }
 
-  // make the program file read only, as long as it is running
-  lock_acquire(&filesys_lock);
-  thread_current()->fi = filesys_open(file_name);
-  file_deny_write(thread_current()->fi);
-  lock_release(&filesys_lock);
-
   // arguments processing
   unsigned argc = 0;
   while(token != NULL)
@@ -200,6 +193,126 @@ start_process (void *file_name_)
   NOT_REACHED ();
 }
 
+// tells the parent, blocked in exec() or fork(), whether this
+// process started successfully
+static void
+exec_status_report (bool success)
+{
+  if(success)
+    thread_current()->exec_status = thread_current()->tid;
+  else
+  {
+    thread_current()->exec_status = -1;
+    thread_current()->exit_status = -1;
+  }
+
+  // if parent is waiting for the exec_status
+  // then unblock it, and block itself, so that
+  // parent can collect the status. As child may
+  // die, without parent collecting the exec_status
+  if(thread_current()->parent_waiting_exec) 
+  {
+    thread_unblock(thread_current()->parent_waiting_exec);
+    intr_disable();
+    thread_block();
+    intr_enable();
+  }
+}
+
+// what a forked child needs from its parent to start running
+struct fork_info
+  {
+    struct thread *parent;              /* Blocked until the child starts. */
+    struct intr_frame if_;              /* Parent's registers at fork(). */
+  };
+
+/* Starts a copy of the current process, which resumes from the
+   system call whose interrupt frame is IF_, with fork()
+   returning 0.  Returns the child's thread id, or TID_ERROR if
+   the thread cannot be created.  The caller must wait for the
+   child to report its exec_status before it runs again. */
+tid_t
+process_fork (struct intr_frame *if_)
+{
+  struct fork_info *info;
+  tid_t tid;
+
+  info = malloc (sizeof *info);
+  if (info == NULL)
+    return TID_ERROR;
+  info->parent = thread_current ();
+  info->if_ = *if_;
+
+  tid = thread_create (thread_current ()->name, PRI_DEFAULT, start_fork, info);
+  if (tid == TID_ERROR)
+    free (info);
+  return tid;
+}
+
+/* A thread function that duplicates the parent's address space
+   and open files, then returns to user mode. */
+static void
+start_fork (void *info_)
+{
+  struct fork_info *info = info_;
+  struct thread *parent = info->parent;
+  struct thread *t = thread_current ();
+  struct intr_frame if_ = info->if_;
+  bool success = false;
+
+  free (info);
+  t->cwd = dir_reopen (t->cwd);
+
+  t->pagedir = pagedir_create ();
+  if (t->pagedir == NULL)
+    goto done;
+#ifdef VM
+  hash_init (&t->shadow_pg_tbl, shadow_hash, shadow_less, NULL);
+  list_init (&t->vma_list);
+  hash_init (&t->map_tbl, map_hash, map_less, NULL);
+  t->map_next_id = 0;
+  t->heap_start = parent->heap_start;
+  t->heap_end = parent->heap_end;
+#endif
+  process_activate ();
+
+  lock_acquire (&filesys_lock);
+  t->fi = file_reopen (parent->fi);
+  if (t->fi != NULL)
+    file_deny_write (t->fi);
+  t->fds = fd_table_dup (parent->fds);
+  lock_release (&filesys_lock);
+  if (t->fi == NULL || t->fds == NULL)
+    goto done;
+
+  /* The parent is blocked until we report back, so its address
+     space holds still while we copy it.  With virtual memory the
+     pages are shared copy-on-write, except 4 MB pages; otherwise
+     they are copied right away. */
+#ifdef VM
+  if (!vma_dup (&t->vma_list, &parent->vma_list, t->fi)
+      || !shadow_pg_tbl_dup (&t->shadow_pg_tbl, &parent->shadow_pg_tbl,
+                             parent->pagedir)
+      || !pagedir_dup_large (t->pagedir, parent->pagedir)
+      || !frame_fork (parent, t))
+    goto done;
+#else
+  if (!pagedir_dup (t->pagedir, parent->pagedir))
+    goto done;
+#endif
+  success = true;
+
+ done:
+  exec_status_report (success);
+  if (!success)
+    thread_exit ();
+
+  /* fork() returns 0 in the child. */
+  if_.eax = 0;
+  asm volatile ("movl %0, %%esp; jmp intr_exit" : : "g" (&if_) : "memory");
+  NOT_REACHED ();
+}
+
 /* Waits for thread TID to die and returns its exit status.  If
    it was terminated by the kernel (i.e. killed due to an
    exception), returns -1.  If TID is invalid or if it was not a
@@ -239,6 +352,9 @@ process_exit (void)
 {
   struct thread *cur = thread_current ();
   uint32_t *pd;
+
+  // let outstanding asynchronous I/O finish before tearing down
+  aio_cleanup();
   
   // clean up zombie children of this process
   zombie_cleanup_on_parent_termination(cur->tid);
@@ -257,6 +373,15 @@ process_exit (void)
          directory before destroying the process's page
          directory, or our active page directory will be one
          that's been freed (and cleared). */
+#ifdef VM
+      // write back mmapped files, then forget this process's frames
+      // and swap slots; the frames themselves are freed with the
+      // page directory below
+      hash_destroy (&cur->map_tbl, map_destructor);
+      frame_release_all (cur->tid);
+      hash_destroy (&cur->shadow_pg_tbl, shadow_destructor);
+      vma_destroy (&cur->vma_list);
+#endif
       cur->pagedir = NULL;
       pagedir_activate (NULL);
       pagedir_destroy (pd);
@@ -267,17 +392,11 @@ process_exit (void)
   file_close(thread_current()->fi);
   lock_release(&filesys_lock);
 
-  // freeup fd table
-  int i = 2; // we start with 2 as 0 and 1 are reserved for STDIN and STDOUT
-  for(; i < FDTABLESIZE; ++i)
-  {
-    if(cur->fd_table[i]) // check if file ptr exist, then close
-    {
-      lock_acquire(&filesys_lock);
-      file_close(cur->fd_table[i]);
-      lock_release(&filesys_lock);
-    }
-  }
+  // close all open files and free up the fd table
+  lock_acquire(&filesys_lock);
+  fd_table_destroy(cur->fds);
+  lock_release(&filesys_lock);
+  cur->fds = NULL;
 }
 
 /* Sets up the CPU for running user code in the current
@@ -383,6 +502,13 @@ load (const char *file_name, void (**eip) (void), void **esp)
   t->pagedir = pagedir_create ();
   if (t->pagedir == NULL) 
     goto done;
+#ifdef VM
+  hash_init (&t->shadow_pg_tbl, shadow_hash, shadow_less, NULL);
+  list_init (&t->vma_list);
+  hash_init (&t->map_tbl, map_hash, map_less, NULL);
+  t->map_next_id = 0;
+  t->heap_start = t->heap_end = NULL;
+#endif
   process_activate ();
 
   /* Open executable file. */
@@ -459,6 +585,13 @@ load (const char *file_name, void (**eip) (void), void **esp)
               if (!load_segment (file, file_page, (void *) mem_page,
                                  read_bytes, zero_bytes, writable))
                 goto done;
+#ifdef VM
+              /* The heap starts after the highest segment. */
+              if ((uint8_t *) mem_page + read_bytes + zero_bytes
+                  > t->heap_start)
+                t->heap_start = (uint8_t *) mem_page + read_bytes
+                                + zero_bytes;
+#endif
             }
           else
             goto done;
@@ -469,6 +602,9 @@ load (const char *file_name, void (**eip) (void), void **esp)
   /* Set up stack. */
   if (!setup_stack (esp))
     goto done;
+#ifdef VM
+  t->heap_end = t->heap_start;
+#endif
 
   /* Start address. */
   *eip = (void (*) (void)) ehdr.e_entry;
@@ -480,8 +616,15 @@ load (const char *file_name, void (**eip) (void), void **esp)
   if(!success)
   {
     DPRINTF("load function failed\n");
+    file_close (file);
+  }
+  else
+  {
+    // keep the executable open and read only as long as it is
+    // running; its pages are loaded from it on demand
+    t->fi = file;
+    file_deny_write (file);
   }
-  file_close (file);
   lock_release(&filesys_lock);
   return success;
 }
@@ -557,6 +700,12 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
   ASSERT (pg_ofs (upage) == 0);
   ASSERT (ofs % PGSIZE == 0);
 
+#ifdef VM
+  /* Only record where the segment comes from; page_fault() reads
+     each page in the first time it is touched. */
+  return vma_create (file, ofs, upage, read_bytes, read_bytes + zero_bytes,
+                     writable, false);
+#else
   file_seek (file, ofs);
   while (read_bytes > 0 || zero_bytes > 0) 
     {
@@ -592,6 +741,7 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
       upage += PGSIZE;
     }
   return true;
+#endif
 }
 
 /* Create a minimal stack by mapping a zeroed page at the top of
@@ -602,14 +752,26 @@ setup_stack (void **esp)
   uint8_t *kpage;
   bool success = false;
 
+#ifdef VM
+  kpage = frame_allocator (PAL_USER | PAL_ZERO);
+#else
   kpage = palloc_get_page (PAL_USER | PAL_ZERO);
+#endif
   if (kpage != NULL) 
     {
-      success = install_page (((uint8_t *) PHYS_BASE) - PGSIZE, kpage, true);
+      uint8_t *upage = ((uint8_t *) PHYS_BASE) - PGSIZE;
+      success = install_page (upage, kpage, true);
       if (success)
         *esp = PHYS_BASE;
+#ifdef VM
+      if (success)
+        insert_vaddr (kpage, upage);
+      else
+        frame_free (kpage);
+#else
       else
         palloc_free_page (kpage);
+#endif
     }
   return success;
 }
@@ -1,5 +1,6 @@
 #include "userprog/syscall.h"
 //14406
+#include <limits.h>
 #include <stdio.h>
 #include <syscall-nr.h>
 #include <string.h>
@@ -7,6 +8,8 @@
 #include "threads/thread.h"
 #include "threads/synch.h"
 #include "threads/init.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
 #include "threads/vaddr.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
@@ -16,8 +19,14 @@
 #include "filesys/inode.h"
 ///////////////////////////////////////////////////////////////////////////////
 #include "process.h"
+#include "fdtable.h"
+#include "ioring.h"
+#include "aio.h"
 #include "pagedir.h"
 #include "devices/input.h"
+#ifdef VM
+#include "vm/page.h"
+#endif
 
 //#define DEBUG
 #include "debug_helper.h"
@@ -25,6 +34,8 @@
 extern struct lock filesys_lock;
 
 int is_valid_address(void* add);
+static bool user_range_ok(const void* start, size_t size);
+static int child_start_wait(tid_t tid);
 static void syscall_handler (struct intr_frame *);
 
 void
@@ -38,6 +49,10 @@ syscall_handler (struct intr_frame *f)
 {
   if(f)
   {
+#ifdef VM
+    // page faults taken on behalf of the process need its esp
+    thread_current()->esp = f->esp;
+#endif
     stack_address_check(f->esp);
 
     int sys_call_no = get_nth_arg_int(f->esp, 0);
@@ -110,9 +125,13 @@ syscall_handler (struct intr_frame *f)
           int fd = get_nth_arg_int(f->esp, 1);
           char* buf = (char*)get_nth_arg_ptr(f->esp, 2); 
           int size = get_nth_arg_int(f->esp, 3);
-          user_add_range_check_and_terminate(buf, size);
-          DPRINTF("sys_read(%d,%s,%d)\n", fd, buf, size);
+          DPRINTF("sys_read(%d,%p,%d)\n", fd, buf, size);
           f->eax = sys_read(fd, buf, size);
+          if((int)f->eax == -1)  // buf is not writable user memory
+          {
+            thread_current()->exit_status = -1;
+            process_terminate();
+          }
         }
         return;
       case SYS_WRITE:
@@ -120,9 +139,13 @@ syscall_handler (struct intr_frame *f)
           int fd = get_nth_arg_int(f->esp, 1);
           char* buf = (char*)get_nth_arg_ptr(f->esp, 2); 
           int size = get_nth_arg_int(f->esp, 3);
-          user_add_range_check_and_terminate(buf, size);
-          DPRINTF("sys_write(%d,%s,%d)\n", fd, buf, size);
+          DPRINTF("sys_write(%d,%p,%d)\n", fd, buf, size);
           f->eax = sys_write(fd, buf, size);
+          if((int)f->eax == -1)  // buf is not readable user memory
+          {
+            thread_current()->exit_status = -1;
+            process_terminate();
+          }
         }
         return;
       case SYS_SEEK:
@@ -168,9 +191,13 @@ syscall_handler (struct intr_frame *f)
       	{
       	      int fd = get_nth_arg_int(f->esp, 1);
       	      char* name = (char*)get_nth_arg_ptr(f->esp, 2); 
-              user_string_add_range_check_and_terminate(name); 
-              DPRINTF("sys_mkdir %d,%s\n", fd,name);
-              f->eax = sys_readdir(fd,name);                   	
+              DPRINTF("sys_readdir %d,%p\n", fd,name);
+              f->eax = sys_readdir(fd,name);
+              if((int)f->eax == -1)  // name is not writable user memory
+              {
+                thread_current()->exit_status = -1;
+                process_terminate();
+              }
       	}
       	return;
       case SYS_ISDIR:
@@ -188,10 +215,97 @@ syscall_handler (struct intr_frame *f)
       	}
       	return;  
  ////////////////////////////////////////////////////////////////////////////////////       
-      /*
+      case SYS_FALLOCATE:
+        {
+          int fd = get_nth_arg_int(f->esp, 1);
+          int offset = get_nth_arg_int(f->esp, 2);
+          int len = get_nth_arg_int(f->esp, 3);
+          DPRINTF("sys_fallocate(%d,%d,%d)\n", fd, offset, len);
+          f->eax = sys_fallocate(fd, offset, len);
+        }
+        return;
+      case SYS_RING_SETUP:
+        {
+          // the address must be unmapped, so it is not dereferenced
+          void* addr = (void*)get_nth_arg_int(f->esp, 1);
+          DPRINTF("ring_setup(%p)\n", addr);
+          f->eax = ring_setup(addr);
+        }
+        return;
+      case SYS_RING_ENTER:
+        {
+          unsigned to_submit = get_nth_arg_int(f->esp, 1);
+          DPRINTF("ring_enter(%u)\n", to_submit);
+          f->eax = ring_enter(to_submit);
+        }
+        return;
+      case SYS_FORK:
+        {
+          DPRINTF("sys_fork()\n");
+          f->eax = sys_fork(f);
+        }
+        return;
+      case SYS_AIO_READ:
+      case SYS_AIO_WRITE:
+        {
+          int fd = get_nth_arg_int(f->esp, 1);
+          char* buf = (char*)get_nth_arg_ptr(f->esp, 2);
+          unsigned size = get_nth_arg_int(f->esp, 3);
+          unsigned offset = get_nth_arg_int(f->esp, 4);
+          DPRINTF("aio_submit(%d,%p,%u,%u)\n", fd, buf, size, offset);
+          f->eax = aio_submit(fd, buf, size, offset,
+                              sys_call_no == SYS_AIO_WRITE);
+        }
+        return;
+      case SYS_AIO_WAIT:
+        {
+          int id = get_nth_arg_int(f->esp, 1);
+          DPRINTF("aio_wait(%d)\n", id);
+          f->eax = aio_wait(id);
+        }
+        return;
+#ifdef VM
       case SYS_MMAP:
+        {
+          int fd = get_nth_arg_int(f->esp, 1);
+          // the address must be unmapped, so it is not dereferenced
+          void* addr = (void*)get_nth_arg_int(f->esp, 2);
+          DPRINTF("sys_mmap(%d,%p)\n", fd, addr);
+          f->eax = sys_mmap(fd, addr);
+        }
+        return;
       case SYS_MUNMAP:
-      */
+        {
+          int mapid = get_nth_arg_int(f->esp, 1);
+          DPRINTF("sys_munmap(%d)\n", mapid);
+          sys_munmap(mapid);
+        }
+        return;
+      case SYS_MADVISE:
+        {
+          // the range is only looked up, never dereferenced
+          void* addr = (void*)get_nth_arg_int(f->esp, 1);
+          unsigned len = get_nth_arg_int(f->esp, 2);
+          int advice = get_nth_arg_int(f->esp, 3);
+          DPRINTF("sys_madvise(%p,%u,%d)\n", addr, len, advice);
+          f->eax = page_madvise(addr, len, advice);
+        }
+        return;
+      case SYS_SETSTACKLIMIT:
+        {
+          unsigned size = get_nth_arg_int(f->esp, 1);
+          DPRINTF("sys_setstacklimit(%u)\n", size);
+          f->eax = page_set_stack_limit(size);
+        }
+        return;
+      case SYS_SBRK:
+        {
+          int increment = get_nth_arg_int(f->esp, 1);
+          DPRINTF("sys_sbrk(%d)\n", increment);
+          f->eax = (uint32_t) page_sbrk(increment);
+        }
+        return;
+#endif
       default:
         thread_exit();
         break;
@@ -220,6 +334,50 @@ void* get_nth_arg_ptr(void* esp, int n)
   return (void*)(*((int*)esp + n));
 }
 
+// the instruction of each user memory accessor that may fault
+// carries a global label, so that page_fault() can tell its faults
+// from kernel bugs; the accessors must thus exist exactly once
+#define USER_ACCESS __attribute__ ((noinline, noclone))
+extern const char get_user_insn[], put_user_insn[], user_copy_insn[];
+
+// reads a byte at user virtual address uaddr, which must be
+// below PHYS_BASE
+// returns the byte value, or -1 if the access faulted
+// * page_fault() resumes a faulting accessor at the address
+//   left in eax, with eax set to -1
+USER_ACCESS int get_user(const char *uaddr)
+{
+  int result;
+  asm ("movl $1f, %0\n"
+       ".globl get_user_insn\n"
+       "get_user_insn: movzbl %1, %0\n"
+       "1:"
+       : "=&a" (result) : "m" (*uaddr));
+  return result;
+}
+
+// writes byte to user virtual address udst, which must be
+// below PHYS_BASE
+// return 0/1 if the access faulted or succeeded
+USER_ACCESS int put_user(char *udst, char byte)
+{
+  int error_code;
+  asm ("movl $1f, %0\n"
+       ".globl put_user_insn\n"
+       "put_user_insn: movb %b2, %1\n"
+       "1:"
+       : "=&a" (error_code), "=m" (*udst) : "q" (byte));
+  return error_code != -1;
+}
+
+// returns whether eip is the instruction of a user memory
+// accessor, whose faults page_fault() turns into an error return
+bool user_access_insn(const void *eip)
+{
+  return eip == get_user_insn || eip == put_user_insn
+         || eip == user_copy_insn;
+}
+
 // check for a range of address for validity
 // the address should be below PHYS_BASE and
 // should be mapped in the page_dir
@@ -230,11 +388,16 @@ void* get_nth_arg_ptr(void* esp, int n)
 // * It checks at the page boundary only
 int user_add_range_check(char* start, int size)
 {
-  unsigned ptr;
+  char* ptr;
+
+  if(size == 0)
+    return 1;
+  if(size < 0 || !start || !user_range_ok(start, size))
+    return 0;
 
-  for(ptr = (unsigned)start; ptr < (unsigned)(start+size); 
-      ptr = ptr + (PGSIZE - ptr % PGSIZE))  // jump to last entry of a page
-    if(!is_valid_address((void*)ptr))
+  for(ptr = start; ptr < start + size;
+      ptr = ptr + (PGSIZE - (unsigned)ptr % PGSIZE))  // jump to next page
+    if(get_user(ptr) == -1)
       return 0;
 
   return 1;
@@ -252,16 +415,72 @@ void user_add_range_check_and_terminate(char* start, int size)
   }
 }
 
+// returns whether [start, start+size-1] lies below PHYS_BASE
+static bool user_range_ok(const void* start, size_t size)
+{
+  return (uintptr_t)start < (uintptr_t)PHYS_BASE
+         && size <= (uintptr_t)PHYS_BASE - (uintptr_t)start;
+}
+
+// copies size bytes from src to dst, either of which may be user
+// memory, resuming like get_user() if the copy faults
+// returns false if it faulted
+USER_ACCESS static bool user_copy(void* dst, const void* src, size_t size)
+{
+  int result;
+  asm volatile ("movl $1f, %0\n"
+                ".globl user_copy_insn\n"
+                "user_copy_insn: rep movsb\n"
+                "movl $0, %0\n"
+                "1:"
+                : "=&a" (result), "+D" (dst), "+S" (src), "+c" (size)
+                : : "memory");
+  return result != -1;
+}
+
+// copies size bytes from user address usrc to kernel buffer dst
+// returns false if the user range is invalid or unmapped
+bool user_copy_in(void* dst, const void* usrc, size_t size)
+{
+  return size == 0 || (user_range_ok(usrc, size) && user_copy(dst, usrc, size));
+}
+
+// copies size bytes from kernel buffer src to user address udst
+// returns false if the user range is invalid, unmapped or read-only
+bool user_copy_out(void* udst, const void* src, size_t size)
+{
+  return size == 0 || (user_range_ok(udst, size) && user_copy(udst, src, size));
+}
+
+// checks for validity of user string
+// return 0/1 if invalid or valid
+// * does not teminate the process
+int user_string_add_range_check(char* str)
+{
+  char* tmp = str;
+  int c;
+
+  if(!tmp)
+    return 0;
+  do  // loop untill NULL is found
+  {
+    if((void*)tmp >= PHYS_BASE)
+      return 0;
+    c = get_user(tmp++);
+    if(c == -1)
+      return 0;
+  } while(c != 0);
+  return 1;
+}
+
 // checks for validity of user string
 // terminates the process if invalid
 void user_string_add_range_check_and_terminate(char* str)
 {
-  char* tmp = str;
-  user_add_range_check_and_terminate(tmp, 1);
-  while(*tmp) // loop untill NULL is found
+  if(!user_string_add_range_check(str))
   {
-    ++tmp;
-    user_add_range_check_and_terminate(tmp, 1); // check and terminate
+    thread_current()->exit_status = -1;
+    process_terminate();
   }
 }
 
@@ -275,7 +494,7 @@ int is_valid_address(void* add)
     return 0;
   if(add >= (void*)PHYS_BASE)
     return 0;
-  if(!pagedir_get_page(thread_current()->pagedir, add))
+  if(get_user(add) == -1)
     return 0;
   
   return 1;
@@ -302,8 +521,21 @@ void process_terminate(void)
 
 int sys_exec(char* filename)
 {
-  tid_t tid = process_execute(filename);
-  if(tid == -1) // process execute failed, return -1
+  return child_start_wait(process_execute(filename));
+}
+
+// duplicates the calling process; returns the child's pid in the
+// parent (0 in the child, see start_fork()), or -1 on failure
+int sys_fork(struct intr_frame *f)
+{
+  return child_start_wait(process_fork(f));
+}
+
+// waits for a child just created by exec() or fork() to report
+// whether it started, and returns its tid, or -1 if it failed
+static int child_start_wait(tid_t tid)
+{
+  if(tid == -1) // process creation failed, return -1
     return -1;
   else  // tid is valid
   {
@@ -332,23 +564,17 @@ int sys_open(char* file_name)
   if(!*file_name)  // empty string check
     return -1;
   struct thread *t = thread_current ();
-  int i = 2;
-  for(; i < FDTABLESIZE; ++i) // find the first free FD
+  int fd = -1;
+  lock_acquire(&filesys_lock);
+  struct file* fi = filesys_open(file_name);
+  if(fi)
   {
-    if(!t->fd_table[i])
-    {
-      lock_acquire(&filesys_lock);
-      struct file* fi = filesys_open(file_name);
-      if(fi)
-        t->fd_table[i] = fi;
-      lock_release(&filesys_lock);
-      if(fi)
-        return i;
-      else
-        return -1;
-    }
+    fd = fd_alloc(t->fds, fi); // lowest free FD, grows the table if full
+    if(fd < 0)
+      file_close(fi);
   }
-  return -1;
+  lock_release(&filesys_lock);
+  return fd;
 }
 
 int sys_create(char* file_name, int size)
@@ -375,123 +601,227 @@ int sys_remove(char* file_name)
 
 void sys_close(int fd)
 {
-  if(fd >= 0 && fd < FDTABLESIZE) // is valid FD?
+  struct thread *t = thread_current ();
+  struct file* fi = fd_remove(t->fds, fd); // NULL if not a valid FD
+  if(fi)
   {
-    struct thread *t = thread_current ();
-    struct file* fi = t->fd_table[fd];
-    if(fi)
-    {
-      lock_acquire(&filesys_lock);
-      file_close(fi);
-      lock_release(&filesys_lock);
-      t->fd_table[fd] = 0;
-    }
+    lock_acquire(&filesys_lock);
+    file_close(fi);
+    lock_release(&filesys_lock);
   }
 }
 
+// writes size bytes from buffer to fd. The data goes through a
+// kernel page, so that a bad buffer fails a copy instead of
+// faulting inside the file system or the console
+// returns the number of bytes written, or -1 if buffer is not
+// readable user memory
 int sys_write(int fd, void *buffer, unsigned size)
 {
+  struct file* fi = NULL;
+  char* kbuf;
+  int done = 0;
+
   if(fd == STDIN_FILENO)
     return 0;
-  else if(fd == STDOUT_FILENO)
+  if(!user_range_ok(buffer, size))
+    return -1;
+  if(fd != STDOUT_FILENO)
   {
-    putbuf(buffer, size);
-    return size;
+    fi = fd_get(thread_current()->fds, fd);
+    if(!fi)
+      return 0;
   }
-  else if(fd < FDTABLESIZE && fd > 1)
+  kbuf = palloc_get_page(0);
+  if(!kbuf)
+    return 0;
+  while((unsigned)done < size)
   {
-    struct thread* cur = thread_current ();
-    struct file* fi = cur->fd_table[fd];
+    int chunk = size - done < PGSIZE ? (int)(size - done) : PGSIZE;
+    int ret = chunk;
+
+    if(!user_copy_in(kbuf, (char*)buffer + done, chunk))
+    {
+      done = -1;
+      break;
+    }
     if(fi)
     {
-      int ret;
       lock_acquire(&filesys_lock);
-      ret = file_write(fi, buffer, size);
+      ret = file_write(fi, kbuf, chunk);
       lock_release(&filesys_lock);
-      return ret;
     }
+    else
+      putbuf(kbuf, chunk);
+    done += ret;
+    if(ret < chunk)
+      break;
   }
-  return 0;
+  palloc_free_page(kbuf);
+  return done;
 }
 
+// reads up to size bytes from fd into buffer, through a kernel
+// page like sys_write()
+// returns the number of bytes read, or -1 if buffer is not
+// writable user memory
 int sys_read(int fd, void* buffer, unsigned size)
 {
+  struct file* fi;
+  char* kbuf;
+  int done = 0;
+
   if(fd == STDOUT_FILENO)
     return 0;
-  else if(fd == STDIN_FILENO)
+  if(!user_range_ok(buffer, size))
+    return -1;
+  if(fd == STDIN_FILENO)
   {
     unsigned i = 0;
     char* buf = (char*) buffer;
     for(; i < size; ++i)
-      buf[i] = input_getc();
+      if(!put_user(buf + i, input_getc()))
+        return -1;
     return 0;
   }
-  else if(fd < FDTABLESIZE && fd > 1)
+  fi = fd_get(thread_current()->fds, fd);
+  if(!fi)
+    return 0;
+  kbuf = palloc_get_page(0);
+  if(!kbuf)
+    return 0;
+  while((unsigned)done < size)
   {
-    struct thread *cur = thread_current ();
-    struct file* fi = cur->fd_table[fd];
-    if(fi)
+    int chunk = size - done < PGSIZE ? (int)(size - done) : PGSIZE;
+    int ret;
+
+    lock_acquire(&filesys_lock);
+    ret = file_read(fi, kbuf, chunk);
+    lock_release(&filesys_lock);
+    if(!user_copy_out((char*)buffer + done, kbuf, ret))
     {
-      int ret;
-      lock_acquire(&filesys_lock);
-      ret = file_read(fi, buffer, size);
-      lock_release(&filesys_lock);
-      return ret;
+      done = -1;
+      break;
     }
+    done += ret;
+    if(ret < chunk)
+      break;
   }
-  return 0;
+  palloc_free_page(kbuf);
+  return done;
 }
 
 int sys_filesize(int fd)
 {
-  if(fd >= 0 && fd < FDTABLESIZE)
+  struct thread *t = thread_current ();
+  struct file* fi = fd_get(t->fds, fd);
+  if(fi)
   {
-    struct thread *t = thread_current ();
-    struct file* fi = t->fd_table[fd];
-    if(fi)
-    {
-      int ret;
-      lock_acquire(&filesys_lock);
-      ret = file_length(fi);
-      lock_release(&filesys_lock);
-      return ret;
-    }
+    int ret;
+    lock_acquire(&filesys_lock);
+    ret = file_length(fi);
+    lock_release(&filesys_lock);
+    return ret;
   }
   return -1;
 }
 
 void sys_seek(int fd, unsigned pos)
 {
-  if(fd >= 0 && fd < FDTABLESIZE)
+  struct thread *t = thread_current ();
+  struct file* fi = fd_get(t->fds, fd);
+  if(fi)
   {
-    struct thread *t = thread_current ();
-    struct file* fi = t->fd_table[fd];
-    if(fi)
-    {
-      lock_acquire(&filesys_lock);
-      file_seek(fi, pos);
-      lock_release(&filesys_lock);
-    }
+    lock_acquire(&filesys_lock);
+    file_seek(fi, pos);
+    lock_release(&filesys_lock);
   }
 }
 
 unsigned sys_tell(int fd)
 {
-  if(fd >= 0 && fd < FDTABLESIZE)
+  struct thread *t = thread_current ();
+  struct file* fi = fd_get(t->fds, fd);
+  if(fi)
+  {
+    unsigned ret;
+    lock_acquire(&filesys_lock);
+    ret = file_tell(fi);
+    lock_release(&filesys_lock);
+    return ret;
+  }
+  return -1;
+}
+// reserves disk space for [offset, offset+len) of the file,
+// preferably as one contiguous run, so that later writes in that
+// range do not allocate; the file grows to offset+len if shorter
+int sys_fallocate(int fd, int offset, int len)
+{
+  if(offset >= 0 && len > 0
+     && len <= INT_MAX - offset) // reject negative and overflowing ranges
   {
     struct thread *t = thread_current ();
-    struct file* fi = t->fd_table[fd];
+    struct file* fi = fd_get(t->fds, fd);
     if(fi)
     {
-      unsigned ret;
+      int ret;
       lock_acquire(&filesys_lock);
-      ret = file_tell(fi);
+      ret = file_allocate(fi, offset, len);
       lock_release(&filesys_lock);
       return ret;
     }
   }
-  return -1;
+  return 0;
+}
+
+#ifdef VM
+// maps the file open as fd at addr; pages are read in when first
+// touched, and written back at munmap or exit if they were changed.
+// The mapping has its own handle on the file, so it outlives close()
+int sys_mmap(int fd, void *addr)
+{
+  struct thread *t = thread_current ();
+  struct file* fi;
+  off_t size = 0;
+
+  if(fd == STDIN_FILENO || fd == STDOUT_FILENO)
+    return -1;
+  lock_acquire(&filesys_lock);
+  fi = fd_get(t->fds, fd);
+  if(fi && !inode_get_status(file_get_inode(fi)))
+  {
+    size = file_length(fi);
+    fi = size > 0 ? file_reopen(fi) : NULL;
+  }
+  else
+    fi = NULL;
+  lock_release(&filesys_lock);
+  if(!fi)
+    return -1;
+
+  if(!mmap_range_free(addr, size))
+  {
+    lock_acquire(&filesys_lock);
+    file_close(fi);
+    lock_release(&filesys_lock);
+    return -1;
+  }
+  return mmap_create(fi, addr, size);
+}
+
+// removes mapping mapid, writing back the pages that were changed
+void sys_munmap(int mapid)
+{
+  struct thread *t = thread_current ();
+  struct map_elem *m = map_table_lookup(&t->map_tbl, mapid);
+
+  if(!m)
+    return;
+  hash_delete(&t->map_tbl, &m->elem);
+  mmap_unmap(m);
+  free(m);
 }
+#endif
 ////////////////////////////////////////////////////////////////////////////////////
 int sys_mkdir(char *path_name)
 {
@@ -565,50 +895,42 @@ int sys_chdir(char *path_name)
 }
 int sys_isdir(int fd)
 {
-    if(fd >= 0 && fd < FDTABLESIZE) // is valid FD?
+    struct thread *t = thread_current ();
+    struct file* fi = fd_get(t->fds, fd);
+    if(fi)
     {
-          struct thread *t = thread_current ();
-          struct file* fi = t->fd_table[fd];
-          if(fi)
-          {
-                struct dir *dir = (struct dir *)fi;
-                struct inode *inode = dir_get_inode(dir);
-                return inode_get_status(inode);
-          }
-  }
+          struct dir *dir = (struct dir *)fi;
+          struct inode *inode = dir_get_inode(dir);
+          return inode_get_status(inode);
+    }
  return 0;
 }
 int sys_inumber(int fd)
 {
-    if(fd >= 0 && fd < FDTABLESIZE)
+    struct thread *t = thread_current ();
+    struct file* fi = fd_get(t->fds, fd);
+    if(fi)
     {
-          struct thread *t = thread_current ();
-          struct file* fi = t->fd_table[fd];
-          if(fi)
-          {
-                return inode_get_sec( file_get_inode(fi));
-          }
-  }
+          return inode_get_sec( file_get_inode(fi));
+    }
  return -1;
 }
 int sys_readdir(int fd,char *name)
 {
-   if(fd >= 0 && fd < FDTABLESIZE)
+    struct thread *t = thread_current ();
+    struct file* fi = fd_get(t->fds, fd);
+    if(fi)
     {
-          struct thread *t = thread_current ();
-          struct file* fi = t->fd_table[fd];
-          if(fi)
+          struct dir *dir = (struct dir *)fi;
+          struct inode *inode = dir_get_inode(dir);
+          if(inode_get_status(inode))
           {
-                struct dir *dir = (struct dir *)fi;
-                struct inode *inode = dir_get_inode(dir);
-                if(inode_get_status(inode))
-                {
-        	      char *s = malloc(15); 
-                      bool succ = dir_readdir (dir, s);
-                      memcpy(name,s,15);
-			return succ;
-                }                
-          }
+                char s[NAME_MAX + 1];
+                bool succ = dir_readdir (dir, s);
+                if(succ && !user_copy_out(name, s, sizeof s))
+                  return -1;
+                return succ;
+          }                
     }
  return 0;       
 }
@@ -2,6 +2,8 @@
 //32306
 #define USERPROG_SYSCALL_H
 
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 void syscall_init (void);
@@ -13,13 +15,20 @@ void stack_address_check(void* esp);
 
 int user_add_range_check(char* start, int size);
 void user_add_range_check_and_terminate(char* start, int size);
+bool user_copy_in(void* dst, const void* usrc, size_t size);
+bool user_copy_out(void* udst, const void* src, size_t size);
 void process_terminate(void);
+int user_string_add_range_check(char* str);
 void user_string_add_range_check_and_terminate(char* str);
 void user_string_add_range_check_and_terminate1(char* str);
 int get_user(const char *uaddr);
 int put_user(char *udst, char byte);
+bool user_access_insn(const void *eip);
+
+struct intr_frame;
 
 int sys_exec(char* filename);
+int sys_fork(struct intr_frame *f);
 int sys_open(char* file_name);
 void sys_close(int fd);
 int sys_write(int fd, void *buffer, unsigned size);
@@ -29,6 +38,9 @@ void sys_seek(int fd, unsigned pos);
 unsigned sys_tell(int fd);
 int sys_remove(char* file_name);
 int sys_create(char* file_name, int size);
+int sys_fallocate(int fd, int offset, int len);
+int sys_mmap(int fd, void *addr);
+void sys_munmap(int mapid);
 /////////////////////////////////////////////////////////////////////////////
 int sys_mkdir(char *path_name);
 int sys_chdir(char *path_name);
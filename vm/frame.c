@@ -1,47 +1,78 @@
+#include <string.h>
+#include "devices/timer.h"
 #include "threads/malloc.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
 #include "frame.h"
+#include "page.h"
 #include "swap.h"
 
+static void frame_unshare_last (struct frame *);
+
+// frames holding read-only executable pages, keyed by (inode, offset),
+// so that processes running the same program map one copy of its text
+static struct hash share_table;
+
+static unsigned share_hash (const struct hash_elem *, void *);
+static bool share_less (const struct hash_elem *, const struct hash_elem *,
+			void *);
+
+// initializes the frame table: one entry per user pool page,
+// indexed by the page's position in the pool
+void frame_init (void)
+{
+	ftable_size = palloc_user_page_cnt ();
+	ftable = calloc (ftable_size, sizeof (struct frame));
+	if (ftable == NULL)
+		PANIC ("cannot allocate frame table");
+	ftable_clock = 0;
+	lock_init (&ftable_lock);
+	hash_init (&share_table, share_hash, share_less, NULL);
+}
+
+// marks the frame table entry temp free again
+static void frame_clear (struct frame *temp)
+{
+	if (temp->clean_sec != (block_sector_t) -1)
+		swap_slot_free (temp->clean_sec);
+	temp->clean_sec = -1;
+	temp->phy_frame = NULL;
+	temp->uvaddr = NULL;
+}
+
 // allocates a physical frame and
-// creates its corresponding list_entry
-// in frame table.
+// fills in its entry in the frame table.
 void *frame_allocator(enum palloc_flags flag)
 {
+	ASSERT (flag & PAL_USER);
 	void *frame = palloc_get_page (flag);
         
-	if (frame == NULL) // eviction
+	while (frame == NULL) // eviction
 	{
-		// if we get a NULL frame call the eviction algorithm
-		// this will free the frame, which can then be used
-		eviction();
-		frame = palloc_get_page (flag);
-		if (frame == NULL)
+		// the reclaimer fell behind: call the eviction algorithm
+		// ourselves, this will free a frame, which can then be used
+		// (unless another thread grabs it first)
+		if (!eviction ())
 			PANIC ("cannot allocate frame after eviction");
+		frame = palloc_get_page (flag);
 	}
 
-	// struct alias_proc *temp1 = malloc (sizeof(struct alias_proc));
-	// temp1->tid = thread_current()->tid;
-
-	struct frame *temp2 = malloc(sizeof(struct frame));
+	struct frame *temp2 = &ftable[palloc_user_page_idx (frame)];
+	lock_acquire (&ftable_lock);
 	temp2->phy_frame = frame;
-	//list_init (&temp2->tid_s);
+	temp2->uvaddr = NULL;	// not evictable until insert_vaddr()
+	temp2->inode = NULL;
+	temp2->cow = false;
+	temp2->evicting = false;
+	temp2->last_use = timer_ticks ();
+	temp2->cleaning = false;
+	temp2->clean_sec = -1;
+	list_init (&temp2->tid_s);
 	temp2->tid = thread_current()->tid;
-	if (!frame_first)
-	{
-	         lock_acquire (&ftable_lock);
-	         list_push_back (&ftable_list, &temp2->elem);
-	         lock_release (&ftable_lock);
-             frame_first = true;
-		 	 clock_ptr = temp2;		// sets the clock ptr to initial frame
-	}
-	else
-	{
-    		lock_acquire(&ftable_lock);
-    		list_insert (&clock_ptr->elem, &temp2->elem);
-    		lock_release(&ftable_lock);
-	}
-
+	lock_release (&ftable_lock);
 
+	// top the free frame pool back up before it runs dry
+	reclaim_wakeup ();
 	return frame;
 }
 
@@ -51,15 +82,15 @@ void frame_free (void *frame)
 {
 	struct frame *temp;
 	
-	// freeing the structure corresponding to frame in ftable list
+	// clearing the entry corresponding to frame in the frame table
 	lock_acquire (&ftable_lock);
 	temp = get_elem_by_frame (frame);
 
-	if(temp == NULL)
-		return;
-
-	list_remove (&temp->elem);
-	free (temp);
+	if(temp != NULL)
+	{
+		frame_share_remove (temp);
+		frame_clear (temp);
+	}
 	lock_release (&ftable_lock);
    
 	// freeing the page designated by frame.
@@ -67,22 +98,434 @@ void frame_free (void *frame)
 	return;
 }
 
+// removes all frame entries of process tid from the frame table,
+// without freeing its private frames; they go back to the pool
+// when the process's page directory is destroyed. Shared frames
+// are unmapped from the current process's page directory here and
+// freed once their last mapper is gone.
+void frame_release_all (tid_t tid)
+{
+	size_t i;
+	uint32_t *pd = thread_current ()->pagedir;
+
+	lock_acquire (&ftable_lock);
+	for (i = 0; i < ftable_size; i++)
+	{
+		struct frame *temp = &ftable[i];
+		if (temp->phy_frame == NULL)
+			continue;
+		if (frame_is_shared (temp))
+		{
+			struct list_elem *a;
+			for (a = list_begin (&temp->tid_s); a != list_end (&temp->tid_s);
+			     a = list_next (a))
+			{
+				struct alias_proc *alias = list_entry (a, struct alias_proc, elem);
+				if (alias->tid == tid)
+				{
+					list_remove (a);
+					free (alias);
+					pagedir_clear_page (pd, temp->uvaddr);
+					break;
+				}
+			}
+			if (!list_empty (&temp->tid_s))
+			{
+				frame_unshare_last (temp);
+				continue;
+			}
+			frame_share_remove (temp);
+			palloc_free_page (temp->phy_frame);
+		}
+		else if (temp->tid != tid)
+			continue;
+
+		frame_clear (temp);
+	}
+	lock_release (&ftable_lock);
+}
+
+// returns whether more than one process may map frame
+bool frame_is_shared (struct frame *frame)
+{
+	return !list_empty (&frame->tid_s);
+}
+
+// turns a fork-shared frame that is down to a single mapper back
+// into a private frame of that process; the caller holds ftable_lock
+static void frame_unshare_last (struct frame *frame)
+{
+	struct alias_proc *alias;
+
+	if (frame->inode != NULL || list_size (&frame->tid_s) != 1)
+		return;
+
+	alias = list_entry (list_pop_front (&frame->tid_s), struct alias_proc, elem);
+	frame->tid = alias->tid;
+	free (alias);
+}
+
+// removes the current process from frame's mappers; the caller
+// holds ftable_lock
+static void frame_unalias (struct frame *frame, tid_t tid)
+{
+	struct list_elem *a;
+
+	for (a = list_begin (&frame->tid_s); a != list_end (&frame->tid_s);
+	     a = list_next (a))
+	{
+		struct alias_proc *alias = list_entry (a, struct alias_proc, elem);
+		if (alias->tid == tid)
+		{
+			list_remove (a);
+			free (alias);
+			break;
+		}
+	}
+	frame_unshare_last (frame);
+}
+
+// adds process tid to frame's mappers; a private frame first becomes
+// shared with its owner. returns false if out of memory
+static bool frame_alias (struct frame *frame, tid_t tid)
+{
+	struct alias_proc *alias = malloc (sizeof (struct alias_proc));
+	struct alias_proc *owner = NULL;
+
+	if (alias == NULL)
+		return false;
+	if (!frame_is_shared (frame))
+	{
+		owner = malloc (sizeof (struct alias_proc));
+		if (owner == NULL)
+		{
+			free (alias);
+			return false;
+		}
+		owner->tid = frame->tid;
+		list_push_back (&frame->tid_s, &owner->elem);
+	}
+	alias->tid = tid;
+	list_push_back (&frame->tid_s, &alias->elem);
+	return true;
+}
+
+// shares every frame of process parent with its forked child:
+// both map each page read-only, and writable pages are copied on
+// the first write fault by either process.
+// returns false if out of memory
+bool frame_fork (struct thread *parent, struct thread *child)
+{
+	size_t i;
+	bool success = true;
+
+	lock_acquire (&ftable_lock);
+	for (i = 0; i < ftable_size && success; i++)
+	{
+		struct frame *temp = &ftable[i];
+		struct shadow_elem *s;
+		struct list_elem *a;
+		bool mapped = false;
+
+		if (temp->phy_frame == NULL || temp->uvaddr == NULL
+		    || pagedir_get_page (parent->pagedir, temp->uvaddr) != temp->phy_frame)
+			continue;
+		if (!frame_is_shared (temp))
+			mapped = temp->tid == parent->tid;
+		else
+			for (a = list_begin (&temp->tid_s); a != list_end (&temp->tid_s);
+			     a = list_next (a))
+				if (list_entry (a, struct alias_proc, elem)->tid == parent->tid)
+					mapped = true;
+		if (!mapped)
+			continue;
+		// mappings of files are not inherited
+		s = shadow_pg_tbl_lookup (&parent->shadow_pg_tbl, temp->uvaddr);
+		if (s != NULL && (s->where).mmap)
+			continue;
+
+		// a clean swap copy only stands in for a private page
+		if (temp->clean_sec != (block_sector_t) -1)
+		{
+			swap_slot_free (temp->clean_sec);
+			temp->clean_sec = -1;
+			pagedir_set_dirty (parent->pagedir, temp->uvaddr, true);
+		}
+		if (pagedir_is_writable (parent->pagedir, temp->uvaddr))
+		{
+			temp->cow = true;
+			pagedir_set_writable (parent->pagedir, temp->uvaddr, false);
+		}
+		success = frame_alias (temp, child->tid)
+			  && pagedir_set_page (child->pagedir, temp->uvaddr,
+					       temp->phy_frame, false);
+		// the page may differ from its backing file, so the
+		// child must not drop it as clean
+		if (success)
+			pagedir_set_dirty (child->pagedir, temp->uvaddr, true);
+	}
+	lock_release (&ftable_lock);
+	return success;
+}
+
+// unmaps upage from the current process if it maps a frame other
+// processes map too; they keep the frame. A frame only this process
+// still maps becomes its private frame.
+// returns true if upage was unmapped
+bool frame_unshare (void *upage)
+{
+	struct thread *t = thread_current ();
+	struct frame *temp;
+	void *kpage;
+	bool unmapped = false;
+
+	lock_acquire (&ftable_lock);
+	kpage = pagedir_get_page (t->pagedir, upage);
+	temp = kpage != NULL ? get_elem_by_frame (kpage) : NULL;
+	if (temp != NULL && frame_is_shared (temp))
+	{
+		if (list_size (&temp->tid_s) > 1)
+		{
+			frame_unalias (temp, t->tid);
+			pagedir_clear_page (t->pagedir, upage);
+			unmapped = true;
+		}
+		else
+		{
+			bool cow = temp->cow;
+
+			frame_share_remove (temp);
+			temp->tid = t->tid;
+			temp->cow = cow;
+		}
+	}
+	lock_release (&ftable_lock);
+	return unmapped;
+}
+
+// marks the user frame kpage as on its way out for the clock, so that
+// its owner can unmap it; returns false if the clock or the cleaner
+// has it already
+bool frame_claim (void *kpage)
+{
+	struct frame *temp;
+	bool claimed = false;
+
+	lock_acquire (&ftable_lock);
+	temp = get_elem_by_frame (kpage);
+	if (temp != NULL && !temp->evicting && !temp->cleaning)
+	{
+		temp->evicting = true;
+		claimed = true;
+	}
+	lock_release (&ftable_lock);
+	return claimed;
+}
+
+// marks kpage as long unused, so that WSClock takes it as soon as
+// the clock reaches it; the caller clears the accessed bit
+void frame_deactivate (void *kpage)
+{
+	struct frame *temp;
+
+	lock_acquire (&ftable_lock);
+	temp = get_elem_by_frame (kpage);
+	if (temp != NULL)
+		temp->last_use = 0;
+	lock_release (&ftable_lock);
+}
+
+// handles the first write to upage of the current process, which
+// maps the zero page: gives the process a zeroed frame of its own.
+// returns false if the page is really read-only
+static bool frame_zero_fault (void *upage)
+{
+	struct thread *t = thread_current ();
+	struct shadow_elem *s = shadow_pg_tbl_lookup (&t->shadow_pg_tbl, upage);
+	void *kpage;
+
+	// pages without a shadow entry are stack pages
+	if (s != NULL && !s->writable)
+		return false;
+
+	kpage = frame_allocator (PAL_USER | PAL_ZERO);
+	pagedir_clear_page (t->pagedir, upage);
+	if (!pagedir_set_page (t->pagedir, upage, kpage, true))
+	{
+		frame_free (kpage);
+		return false;
+	}
+	insert_vaddr (kpage, upage);
+	return true;
+}
+
+// handles a write fault on upage of the current process, which is
+// mapped read-only; if the frame is copy-on-write, gives the process
+// its own writable copy (or just write access, if it is the last
+// mapper). returns false if the page is really read-only
+bool frame_cow_fault (void *upage)
+{
+	uint32_t *pd = thread_current ()->pagedir;
+	tid_t tid = thread_current ()->tid;
+	struct frame *temp;
+	void *kpage, *copy;
+
+	kpage = pagedir_get_page (pd, upage);
+	if (kpage == zero_page)
+		return frame_zero_fault (upage);
+
+	lock_acquire (&ftable_lock);
+	temp = kpage != NULL ? get_elem_by_frame (kpage) : NULL;
+	if (temp == NULL || !temp->cow)
+	{
+		lock_release (&ftable_lock);
+		return false;
+	}
+	if (!frame_is_shared (temp))
+	{
+		pagedir_set_writable (pd, upage, true);
+		temp->cow = false;
+		lock_release (&ftable_lock);
+		return true;
+	}
+	lock_release (&ftable_lock);
+
+	// allocating may evict, so it cannot happen under ftable_lock;
+	// if the shared frame went away meanwhile, the faulting access
+	// is simply retried
+	copy = frame_allocator (PAL_USER);
+	lock_acquire (&ftable_lock);
+	if (pagedir_get_page (pd, upage) != kpage || !frame_is_shared (temp))
+	{
+		lock_release (&ftable_lock);
+		frame_free (copy);
+		return true;
+	}
+	memcpy (copy, kpage, PGSIZE);
+	frame_unalias (temp, tid);
+	pagedir_clear_page (pd, upage);
+	if (!pagedir_set_page (pd, upage, copy, true))
+	{
+		lock_release (&ftable_lock);
+		frame_free (copy);
+		return false;
+	}
+	lock_release (&ftable_lock);
+
+	insert_vaddr (copy, upage);
+	return true;
+}
+
+// maps the shared frame holding page ofs of inode, if there is one,
+// read-only at upage in the current process
+// returns true if the page was mapped
+bool frame_share_map (struct inode *inode, off_t ofs, void *upage)
+{
+	struct frame key;
+	struct hash_elem *e;
+	struct alias_proc *alias;
+	bool success = false;
+
+	key.inode = inode;
+	key.ofs = ofs;
+	alias = malloc (sizeof (struct alias_proc));
+	if (alias == NULL)
+		return false;
+	alias->tid = thread_current ()->tid;
+
+	// mapping under the frame table lock keeps eviction from
+	// freeing the frame in between
+	lock_acquire (&ftable_lock);
+	e = hash_find (&share_table, &key.share_elem);
+	if (e != NULL)
+	{
+		struct frame *f = hash_entry (e, struct frame, share_elem);
+		if (pagedir_set_page (thread_current ()->pagedir, upage,
+				      f->phy_frame, false))
+		{
+			list_push_back (&f->tid_s, &alias->elem);
+			success = true;
+		}
+	}
+	lock_release (&ftable_lock);
+
+	if (!success)
+		free (alias);
+	return success;
+}
+
+// makes frame, which the current process has just loaded with page
+// ofs of inode and mapped read-only, available to other processes
+// running the same executable
+void frame_share_add (void *frame, struct inode *inode, off_t ofs)
+{
+	struct alias_proc *alias = malloc (sizeof (struct alias_proc));
+	struct frame *temp;
+
+	if (alias == NULL)
+		return;		// stays private
+	alias->tid = thread_current ()->tid;
+
+	lock_acquire (&ftable_lock);
+	temp = get_elem_by_frame (frame);
+	if (temp != NULL)
+	{
+		temp->inode = inode;
+		temp->ofs = ofs;
+		// another process may have loaded the same page meanwhile
+		if (hash_insert (&share_table, &temp->share_elem) == NULL)
+		{
+			list_push_back (&temp->tid_s, &alias->elem);
+			alias = NULL;
+		}
+		else
+			temp->inode = NULL;
+	}
+	lock_release (&ftable_lock);
+
+	free (alias);
+}
+
+// withdraws frame from the shared page table, if it is there, and
+// forgets its mappers; the caller holds ftable_lock
+void frame_share_remove (struct frame *frame)
+{
+	if (frame->inode != NULL)
+		hash_delete (&share_table, &frame->share_elem);
+	while (!list_empty (&frame->tid_s))
+		free (list_entry (list_pop_front (&frame->tid_s),
+				  struct alias_proc, elem));
+	frame->inode = NULL;
+	frame->cow = false;
+}
+
+static unsigned share_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+	const struct frame *f = hash_entry (e, struct frame, share_elem);
+	return hash_bytes (&f->inode, sizeof f->inode) ^ hash_int (f->ofs);
+}
+
+static bool share_less (const struct hash_elem *a_, const struct hash_elem *b_,
+			void *aux UNUSED)
+{
+	const struct frame *a = hash_entry (a_, struct frame, share_elem);
+	const struct frame *b = hash_entry (b_, struct frame, share_elem);
+
+	if (a->inode != b->inode)
+		return a->inode < b->inode;
+	return a->ofs < b->ofs;
+}
+
 // returns the element corresponding to frame
-// in frame table
+// in frame table, or NULL if frame is not a user frame
+// in use; the entry sits at the frame's index in the user pool
 struct frame *get_elem_by_frame (void *frame)
 {
-        struct list_elem *f;
-        struct frame *ret;
-  
-        ret = NULL;
-        for (f = list_begin (&ftable_list); f != list_end (&ftable_list); f = list_next (f))
-        {
-             ret = list_entry (f, struct frame, elem);
-             if (ret->phy_frame == frame)
-                   return ret;
-        }
-      
-        return NULL;
+        size_t idx = palloc_user_page_idx (frame);
+
+        if (idx >= ftable_size || ftable[idx].phy_frame != frame)
+                return NULL;
+        return &ftable[idx];
 }
 
 // inserts uvaddr field corresponding to frame
@@ -2,15 +2,27 @@
 #define VM_FRAME_H
 
 #include <debug.h>
+#include <hash.h>
 #include <list.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include "devices/block.h"
+#include "filesys/off_t.h"
 #include "threads/palloc.h"
 #include "threads/synch.h"
 #include "threads/thread.h"
 
+void frame_init (void);
 void *frame_allocator(enum palloc_flags );
 void frame_free (void *);
+void frame_release_all (tid_t);
+bool frame_share_map (struct inode *, off_t, void *);
+bool frame_fork (struct thread *, struct thread *);
+bool frame_cow_fault (void *);
+bool frame_unshare (void *);
+bool frame_claim (void *);
+void frame_deactivate (void *);
+void frame_share_add (void *, struct inode *, off_t);
 void free_list (struct list *);
 void insert_vaddr (void *, void * );
 
@@ -26,18 +38,35 @@ struct frame
 {
 	void *phy_frame;	// stores return value of palloc_get_page()
 	void *uvaddr;	        // user virtual address corresponding to the physical frame
-	//struct list tid_s;	// list of processes using the frame (for sharing purpose)
 	tid_t tid;              // tid of the process which is allowed to use this physical frame
 
-	struct list_elem elem;	// this will constitute the element of list
+	// read-only executable pages are shared by every process running
+	// the same executable, and fork() shares all of a process's frames
+	// with the child; for shared frames, tid is unused and tid_s lists
+	// the mappers instead
+	struct inode *inode;	// executable backing a shared text frame, else NULL
+	off_t ofs;		// offset of the page in the executable
+	struct list tid_s;	// list of processes using the frame (for sharing purpose)
+	struct hash_elem share_elem;	// element in the shared page table
+	bool cow;		// mapped read-only but writable: copy on write fault
+	bool evicting;		// picked by the clock, on its way out
+
+	// used by WSClock replacement (swap_wsclock)
+	int64_t last_use;	// timer tick the page was last seen accessed
+	bool cleaning;		// queued for, or being written by, the cleaner
+	block_sector_t clean_sec;	// swap copy made by the cleaner while the
+					// page stayed clean, else -1
+
 }; 
 
 struct frame *get_elem_by_frame (void *);
+bool frame_is_shared (struct frame *);
+void frame_share_remove (struct frame *);
 
-struct list ftable_list;	// global list of frame table
+struct frame *ftable;		// frame table, indexed by user pool page number
+size_t ftable_size;		// number of entries in the frame table
 struct lock ftable_lock;	// lock for the frame table
-struct frame *clock_ptr;	// clock pointer - used for implementing the clock algorithm
-bool frame_first;		// check whether the frame inserted is first...
-				// ... clock ptr is initially set to this frame
+size_t ftable_clock;		// clock hand - index of the next frame the
+				// clock algorithm looks at
 
 #endif /* vm/frame.h */
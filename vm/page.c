@@ -1,5 +1,9 @@
+#include <round.h>
 #include <string.h>
+#include "threads/interrupt.h"
 #include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/pte.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
 #include "userprog/pagedir.h"
@@ -9,6 +13,7 @@
 
 
 static bool install_page (void *upage, void *kpage, bool writable);
+static uint8_t *stack_bottom (struct thread *t);
 
 /* Returns a hash value for page p. */
 unsigned
@@ -73,166 +78,566 @@ map_table_lookup (struct hash *ht, int mapid)
   return e != NULL ? hash_entry (e, struct map_elem, elem) : NULL;
 }
 
+// returns the vma of process t covering upage, or NULL. Only t
+// changes its vma list, with interrupts off, so evictors read it
+// with interrupts off
+struct vma *vma_lookup (struct thread *t, const void *upage)
+{
+  struct list_elem *e;
+
+  for (e = list_begin (&t->vma_list); e != list_end (&t->vma_list);
+       e = list_next (e))
+  {
+    struct vma *v = list_entry (e, struct vma, elem);
+    if ((const uint8_t *) upage < v->start)
+      break;
+    if ((const uint8_t *) upage < v->end)
+      return v;
+  }
+  return NULL;
+}
+
+// returns the offset in v's file of page upage of v
+off_t vma_page_ofs (const struct vma *v, const void *upage)
+{
+  return v->ofs + ((const uint8_t *) upage - v->start);
+}
+
+// returns how many bytes of page upage of v are read from the file
+size_t vma_page_read_bytes (const struct vma *v, const void *upage)
+{
+  off_t left = v->read_bytes - ((const uint8_t *) upage - v->start);
+
+  if (left <= 0)
+    return 0;
+  return left < PGSIZE ? left : PGSIZE;
+}
+
+// inserts v into the current process's vma list, in order
+static void vma_insert (struct vma *v)
+{
+  struct list *vmas = &thread_current ()->vma_list;
+  struct list_elem *e;
+  enum intr_level old_level;
+
+  for (e = list_begin (vmas); e != list_end (vmas); e = list_next (e))
+    if (list_entry (e, struct vma, elem)->start > v->start)
+      break;
+  old_level = intr_disable ();
+  list_insert (e, &v->elem);
+  intr_set_level (old_level);
+}
+
+// returns whether any vma of the current process overlaps the
+// pages [start, end)
+static bool vma_overlaps (const uint8_t *start, const uint8_t *end)
+{
+  struct list *vmas = &thread_current ()->vma_list;
+  struct list_elem *e;
+
+  for (e = list_begin (vmas); e != list_end (vmas); e = list_next (e))
+  {
+    struct vma *v = list_entry (e, struct vma, elem);
+    if (v->start >= end)
+      break;
+    if (v->end > start)
+      return true;
+  }
+  return false;
+}
+
+// records that the size bytes (a multiple of PGSIZE) of the current
+// process from upage hold file from ofs on: read_bytes bytes of it,
+// then zeros. Pages are read in on first access.
+// returns false if out of memory or the pages overlap another vma
+bool vma_create (struct file *file, off_t ofs, void *upage, off_t read_bytes,
+                 size_t size, bool writable, bool mmap)
+{
+  struct vma *v;
+
+  ASSERT (pg_ofs (upage) == 0 && size % PGSIZE == 0);
+  if (vma_overlaps (upage, (uint8_t *) upage + size))
+    return false;
+  v = malloc (sizeof (struct vma));
+  if (v == NULL)
+    return false;
+  v->start = upage;
+  v->end = (uint8_t *) upage + size;
+  v->file = file;
+  v->ofs = ofs;
+  v->read_bytes = read_bytes;
+  v->writable = writable;
+  v->mmap = mmap;
+  v->advice = MADV_NORMAL;
+  vma_insert (v);
+  return true;
+}
+
+// splits vma v of the current process at page addr, inside v
+// returns the upper part, or NULL if out of memory
+static struct vma *vma_split (struct vma *v, uint8_t *addr)
+{
+  struct vma *upper = malloc (sizeof (struct vma));
+  off_t below = addr - v->start;
+  enum intr_level old_level;
+
+  if (upper == NULL)
+    return NULL;
+  *upper = *v;
+  upper->start = addr;
+  upper->ofs = v->ofs + below;
+  upper->read_bytes = v->read_bytes > below ? v->read_bytes - below : 0;
+
+  old_level = intr_disable ();
+  v->end = addr;
+  if (v->read_bytes > below)
+    v->read_bytes = below;
+  list_insert (list_next (&v->elem), &upper->elem);
+  intr_set_level (old_level);
+  return upper;
+}
+
+// removes and frees the vmas of the current process within the
+// pages [start, end)
+void vma_remove (void *start, void *end)
+{
+  struct list *vmas = &thread_current ()->vma_list;
+  struct list_elem *e = list_begin (vmas);
+
+  while (e != list_end (vmas))
+  {
+    struct vma *v = list_entry (e, struct vma, elem);
+    enum intr_level old_level;
+
+    if (v->start >= (uint8_t *) end)
+      break;
+    if (v->start < (uint8_t *) start)
+    {
+      e = list_next (e);
+      continue;
+    }
+    old_level = intr_disable ();
+    e = list_remove (e);
+    intr_set_level (old_level);
+    free (v);
+  }
+}
+
+// fills the empty vma list dst of a forked child with a copy of src,
+// minus mmapped files; program segments are read from exe, the
+// child's own handle on the executable, and the heap stays anonymous
+// returns false if out of memory
+bool vma_dup (struct list *dst, struct list *src, struct file *exe)
+{
+  struct list_elem *e;
+
+  for (e = list_begin (src); e != list_end (src); e = list_next (e))
+  {
+    struct vma *v = list_entry (e, struct vma, elem);
+    struct vma *copy;
+
+    if (v->mmap)
+      continue;
+    copy = malloc (sizeof (struct vma));
+    if (copy == NULL)
+      return false;
+    *copy = *v;
+    // the heap has no file
+    if (v->file != NULL)
+      copy->file = exe;
+    list_push_back (dst, &copy->elem);
+  }
+  return true;
+}
+
+// frees every vma in vmas, the list of the current process
+void vma_destroy (struct list *vmas)
+{
+  while (!list_empty (vmas))
+  {
+    enum intr_level old_level = intr_disable ();
+    struct vma *v = list_entry (list_pop_front (vmas), struct vma, elem);
+    intr_set_level (old_level);
+    free (v);
+  }
+}
+
+// creates the shadow entry of page upage of vma v of the current
+// process, which has none yet
+// returns NULL if out of memory
+static struct shadow_elem *page_entry_create (struct vma *v, void *upage)
+{
+  struct thread *t = thread_current ();
+  struct shadow_elem *s = malloc (sizeof (struct shadow_elem));
+  enum intr_level old_level;
+
+  if (s == NULL)
+    return NULL;
+  s->uvaddr = upage;
+  (s->where).ex = !v->mmap;
+  (s->where).mmap = v->mmap;
+  (s->where).swap = false;
+  (s->where).loaded = false;
+  s->writable = v->writable;
+
+  // evictors insert entries of their own with interrupts off
+  old_level = intr_disable ();
+  hash_insert (&t->shadow_pg_tbl, &s->elem);
+  intr_set_level (old_level);
+  return s;
+}
+
+// frees the shadow entry s of the current process
+static void page_entry_delete (struct shadow_elem *s)
+{
+  enum intr_level old_level = intr_disable ();
+  hash_delete (&thread_current ()->shadow_pg_tbl, &s->elem);
+  intr_set_level (old_level);
+  free (s);
+}
+
+// returns the shadow entry of page upage of the current process,
+// creating it if upage lies in a vma and was not touched yet
+// returns NULL if upage is not part of the address space (a stack
+// page that was never swapped out, or no page at all)
+struct shadow_elem *page_lookup (void *upage)
+{
+  struct thread *t = thread_current ();
+  struct shadow_elem *s = shadow_pg_tbl_lookup (&t->shadow_pg_tbl, upage);
+  struct vma *v;
+
+  if (s != NULL)
+    return s;
+  v = vma_lookup (t, upage);
+  return v != NULL ? page_entry_create (v, upage) : NULL;
+}
+
 // destructs and frees the sahdow page table corresponding to the process
+// resident frames are not freed here: they are dropped from the frame
+// table by frame_release_all() and freed along with the page directory
 void shadow_destructor (struct hash_elem *he, void *aux UNUSED)
 {
   struct shadow_elem *s = hash_entry(he, struct shadow_elem, elem);
-  struct thread *t = thread_current();
-  if(!(s->where).ex && !(s->where).mmap)
-  {
-   if ((s->where).swap)
-       {
-           swap_free (s);
-       }
-   else
-       {
-          void *kadd = pagedir_get_page (t->pagedir, (void *)s->uvaddr);
-          frame_free(kadd);
-       }
+  if ((s->where).swap)
+    swap_free (s);
+  free (s);
+}
 
-  }
-  if((s->where).ex)
+// fills the empty shadow page table dst of a forked child with a
+// copy of src, the table of page directory src_pd, minus mmapped
+// files; swapped out pages get their own swap slot. Pages mapping
+// the zero page are mapped again when the child touches them.
+// returns false if out of memory or swap
+bool shadow_pg_tbl_dup (struct hash *dst, struct hash *src, uint32_t *src_pd)
+{
+  struct hash_iterator i;
+
+  hash_first (&i, src);
+  while (hash_next (&i))
   {
-     if((s->where).loaded)
-     {
-        if ((s->where).swap)
-        {
-            swap_free (s);
-        }
-        else
-        {
-            void *kadd = pagedir_get_page (t->pagedir, (void *)s->uvaddr);
-            frame_free(kadd);
-        }
+    struct shadow_elem *s = hash_entry (hash_cur (&i), struct shadow_elem, elem);
+    struct shadow_elem *copy;
+
+    // mappings of files are not inherited
+    if ((s->where).mmap)
+      continue;
+    copy = malloc (sizeof (struct shadow_elem));
+    if (copy == NULL)
+      return false;
+    *copy = *s;
+    if (pagedir_get_page (src_pd, s->uvaddr) == zero_page)
+      (copy->where).loaded = false;
+    if ((copy->where).swap)
+    {
+      copy->sec_no = swap_dup (s->sec_no);
+      if ((int)copy->sec_no == -1)
+      {
+        free (copy);
+        return false;
       }
+    }
+    hash_insert (dst, &copy->elem);
   }
+  return true;
 }
 
-// destructs and frees the map table corresponding to the process
+// destructs and frees the map table corresponding to the process,
+// writing back every mapping
 void map_destructor (struct hash_elem *he, void *aux UNUSED)
 {
   struct map_elem *m = hash_entry(he, struct map_elem, elem);
+  mmap_unmap (m);
   free (m);
 }
 
-
-//creates a shadow entry corresponding to executable in shadow page table
-bool create_shadow_entry_exec (struct file *file, off_t ofs, uint8_t *upage, 
-		      	uint32_t read_bytes, uint32_t zero_bytes, bool writable)
+// returns whether size bytes from page-aligned user address addr are
+// free to be mapped: nothing mapped there and nothing recorded in the
+// shadow page table
+bool mmap_range_free (void *addr, off_t size)
 {
-  struct shadow_elem *s;   	  	
-  s = malloc ( sizeof (struct shadow_elem));
-  s->uvaddr = (void *) upage;
-  
-  // sets the location variables
-  (s->where).ex = true;
-  (s->where).mmap = false;
-  (s->where).swap = false;
-  (s->where).loaded = false;
+  struct thread *t = thread_current ();
+  uint8_t *upage;
 
-  s->f_ex = file;
-  s->ofs_ex = ofs;               // sets the offset
-  s->read_bytes_ex = read_bytes; // stores read bytes
-  s->zero_bytes_ex = zero_bytes; // stores zero bytes
-  s->writable = writable;
+  if (addr == NULL || pg_ofs (addr) != 0 || !is_user_vaddr (addr)
+      || size <= 0 || (uint8_t *) PHYS_BASE - (uint8_t *) addr < size)
+    return false;
+  if (vma_overlaps (addr, (uint8_t *) addr + ROUND_UP (size, PGSIZE))
+      || (uint8_t *) addr + ROUND_UP (size, PGSIZE)
+         > stack_bottom (t) - STACK_GUARD * PGSIZE)
+    return false;
+  for (upage = addr; upage < (uint8_t *) addr + size; upage += PGSIZE)
+    if (pagedir_get_page (t->pagedir, upage) != NULL
+        || shadow_pg_tbl_lookup (&t->shadow_pg_tbl, upage) != NULL)
+      return false;
+  return true;
+}
+
+// maps the first size bytes of file at addr of the current process;
+// pages are read in on first access. addr must have passed
+// mmap_range_free(). The mapping owns file from now on, and closes
+// it at unmap or on failure.
+// returns the mapid, or -1 if out of memory
+int mmap_create (struct file *file, void *addr, off_t size)
+{
+  struct thread *t = thread_current ();
+  struct map_elem *m = malloc (sizeof (struct map_elem));
 
-  s->f_mm = NOT_APP_PTR;
-  s->ofs_mm = NOT_APP_INT;
-  s->read_bytes_mm = NOT_APP_INT;
+  if (m == NULL
+      || !vma_create (file, 0, addr, size, ROUND_UP (size, PGSIZE), true, true))
+  {
+    bool locked = filesys_lock_enter ();
+    file_close (file);
+    if (locked)
+      lock_release (&filesys_lock);
+    free (m);
+    return -1;
+  }
+  m->mapid = t->map_next_id++;
+  m->uvaddr = addr;
+  m->size = size;
+  m->file = file;
+  hash_insert (&t->map_tbl, &m->elem);
+  return m->mapid;
+}
 
+// removes mapping m from the current process: pages written to are
+// written back to the file, the rest are just dropped. Closes the
+// mapping's file; m itself is left to the caller
+void mmap_unmap (struct map_elem *m)
+{
   struct thread *t = thread_current ();
-  if( hash_insert (&t->shadow_pg_tbl, &s->elem) != NULL )
-	return false;
+  uint8_t *upage;
+  bool locked;
 
-  return true;
+  pagedir_batch_begin ();
+  for (upage = m->uvaddr; upage < (uint8_t *) m->uvaddr + m->size;
+       upage += PGSIZE)
+  {
+    struct shadow_elem *s = shadow_pg_tbl_lookup (&t->shadow_pg_tbl, upage);
+    void *kpage;
 
+    if (s == NULL)
+      continue;
+    // a page being evicted is written back by the evictor, which
+    // needs the file system lock; wait for it to finish
+    locked = filesys_lock_enter ();
+    while ((kpage = pagedir_get_page (t->pagedir, upage)) != NULL
+           && !frame_claim (kpage))
+    {
+      if (locked)
+        lock_release (&filesys_lock);
+      thread_yield ();
+      locked = filesys_lock_enter ();
+    }
+    if (kpage != NULL)
+    {
+      off_t ofs = upage - (uint8_t *) m->uvaddr;
+      if (pagedir_is_dirty (t->pagedir, upage))
+        file_write_at (m->file, kpage,
+                       m->size - ofs < PGSIZE ? m->size - ofs : PGSIZE, ofs);
+      pagedir_clear_page (t->pagedir, upage);
+      frame_free (kpage);
+    }
+    if (locked)
+      lock_release (&filesys_lock);
+
+    page_entry_delete (s);
+  }
+  pagedir_batch_end ();
+  vma_remove (m->uvaddr, (uint8_t *) m->uvaddr + ROUND_UP (m->size, PGSIZE));
+
+  locked = filesys_lock_enter ();
+  file_close (m->file);
+  if (locked)
+    lock_release (&filesys_lock);
 }
 
-// creates the shadow page table entry corresponding to the memory mapped files
-bool create_shadow_entry_mmap (struct file *file, off_t ofs, uint8_t *upage, 
-            uint32_t read_bytes)
+
+// number of pages fault_around() maps after a fault in v
+static int fault_around_window (struct vma *v)
 {
-  struct shadow_elem *s;    
-  s = malloc ( sizeof (struct shadow_elem));
-  s->uvaddr = (void *) upage;
-  
-  // sets the location variables
-  (s->where).ex = false;
-  (s->where).mmap = true;
-  (s->where).swap = false;
-  (s->where).loaded = false;
+  if (v->advice == MADV_RANDOM)
+    return 0;
+  if (v->advice == MADV_SEQUENTIAL)
+    return 4 * FAULT_AROUND;
+  return FAULT_AROUND;
+}
+
+// maps up to FAULT_AROUND pages of v following s that are not in
+// yet, so that a sequential scan or program startup takes one fault
+// per run of pages. While free frames are plentiful they are read
+// from the file; otherwise only pages that cost no frame are mapped:
+// text another process has in memory, and bss
+static void fault_around (struct vma *v, struct shadow_elem *s)
+{
+  struct thread *t = thread_current ();
+  int window = fault_around_window (v);
+  int i;
 
-  s->f_ex = NOT_APP_PTR;
-  s->ofs_ex = NOT_APP_INT;
-  s->read_bytes_ex = NOT_APP_INT;
-  s->zero_bytes_ex = NOT_APP_INT;
-  s->writable = NOT_APP_INT;
+  for (i = 1; i <= window; i++)
+  {
+    uint8_t *upage = (uint8_t *) s->uvaddr + i * PGSIZE;
+    struct shadow_elem *n;
+    bool in;
 
-  s->f_mm = file;                 // stores file ptr
-  s->ofs_mm = ofs;                // stores the offset
-  s->read_bytes_mm = read_bytes;  // stores the read bytes
+    if (upage >= v->end)
+      break;
+    n = shadow_pg_tbl_lookup (&t->shadow_pg_tbl, upage);
+    if (n != NULL && ((n->where).swap || (n->where).loaded))
+      break;
+    if (n == NULL && (n = page_entry_create (v, upage)) == NULL)
+      break;
 
+    if (reclaim_headroom ())
+      in = v->mmap ? load_frm_mmap (v, n) : load_frm_exec (v, n);
+    else if (!v->mmap && vma_page_read_bytes (v, upage) == 0)
+      in = load_frm_exec (v, n);
+    else if (!v->mmap && !v->writable
+             && frame_share_map (file_get_inode (v->file),
+                                 vma_page_ofs (v, upage), upage))
+    {
+      (n->where).loaded = true;
+      in = true;
+    }
+    else
+      in = false;
+    if (!in)
+      break;
+  }
+}
+
+// a sequential reader is done with the pages of v before s: makes
+// the window of them just behind s the first ones to be evicted
+static void drop_behind (struct vma *v, struct shadow_elem *s)
+{
   struct thread *t = thread_current ();
-  if( hash_insert (&t->shadow_pg_tbl, &s->elem) != NULL )
-    return false;
+  int window = fault_around_window (v);
+  int i;
 
-  return true;
+  for (i = 1; i <= window; i++)
+  {
+    uint8_t *upage = (uint8_t *) s->uvaddr - i * PGSIZE;
+    void *kpage;
 
+    if (upage < v->start)
+      break;
+    kpage = pagedir_get_page (t->pagedir, upage);
+    if (kpage == NULL || kpage == zero_page)
+      continue;
+    pagedir_set_accessed (t->pagedir, upage, false);
+    frame_deactivate (kpage);
+  }
 }
 
 // load page depending upon where it is placed
-void demand_page (struct shadow_elem *s)
-{
-  // loads from executable
-  if ((s->where).ex && !(s->where).loaded )
-    load_frm_exec (s);
-  // loads from mmap
-  else if ((s->where).mmap)
-    load_frm_mmap (s);
+// returns false if the page could not be brought in
+bool demand_page (struct shadow_elem *s)
+{
+  struct vma *v;
+  bool success;
+
   // loads from swap space
-  else if ((s->where).swap)
-    load_frm_swap (s);
-    
+  if ((s->where).swap)
+    return load_frm_swap (s);
+  if ((s->where).loaded
+      || (v = vma_lookup (thread_current (), s->uvaddr)) == NULL)
+    return false;
+  // loads from executable or mmap
+  success = v->mmap ? load_frm_mmap (v, s) : load_frm_exec (v, s);
+
+  if (success)
+  {
+    fault_around (v, s);
+    if (v->advice == MADV_SEQUENTIAL)
+      drop_behind (v, s);
+  }
+  return success;
+}
+
+// acquires the file system lock unless this thread already holds
+// it, which happens when a syscall touches a non-resident page of
+// its buffer while reading or writing a file
+// returns whether the lock was acquired
+bool filesys_lock_enter (void)
+{
+  if (lock_held_by_current_thread (&filesys_lock))
+    return false;
+  lock_acquire (&filesys_lock);
+  return true;
 }
 
 //load the page from executable file
-bool load_frm_exec (struct shadow_elem *s)
+bool load_frm_exec (struct vma *v, struct shadow_elem *s)
 {
 	
   // reading in variables
-  struct file *file = s->f_ex; 
-  off_t ofs = s->ofs_ex;
+  struct file *file = v->file; 
   uint8_t *upage = (uint8_t *)s->uvaddr;
-  uint32_t read_bytes = s->read_bytes_ex; 
-  uint32_t zero_bytes = s->zero_bytes_ex;
-  bool writable = s->writable;
+  off_t ofs = vma_page_ofs (v, upage);
+  bool writable = v->writable;
 
-  size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
+  size_t page_read_bytes = vma_page_read_bytes (v, upage);
   size_t page_zero_bytes = PGSIZE - page_read_bytes;
 
-  ASSERT ((read_bytes + zero_bytes) % PGSIZE == 0);
+  // read-only pages may already be in memory for another process
+  // running the same executable; the heap has no file
+  struct inode *inode = file != NULL ? file_get_inode (file) : NULL;
+  if (!writable && frame_share_map (inode, ofs, upage))
+  {
+    (s->where).loaded = true;
+    return true;
+  }
+
+  // pages with nothing to read (bss) map the shared zero page and
+  // get a frame of their own on the first write
+  if (page_read_bytes == 0)
+  {
+    if (!install_page (upage, zero_page, false))
+      return false;
+    (s->where).loaded = true;
+    return true;
+  }
+
     /* Get a frame of memory. */
   uint8_t *kpage = frame_allocator (PAL_USER);
   if (kpage == NULL)
       return false;
 
-  lock_acquire(&filesys_lock);
-  file_seek (file, ofs);
-  if (file_read (file, kpage, page_read_bytes) != (int) page_read_bytes)
+  bool locked = filesys_lock_enter ();
+  if (file_read_at (file, kpage, page_read_bytes, ofs) != (int) page_read_bytes)
   {
         // if not successful in reading, free the frame
+        if (locked)
+          lock_release(&filesys_lock);
         frame_free (kpage);
-        lock_release(&filesys_lock);
         return false; 
   }
-  lock_release(&filesys_lock);
+  if (locked)
+    lock_release(&filesys_lock);
 
   // set to the zero the remaining bytes of page
   memset (kpage + page_read_bytes, 0, page_zero_bytes);
 
-  //insert uvaddr in the element of ftable_list
-  insert_vaddr (kpage, upage); 
-
   /* Add the page to the process's address space. */
   if (!install_page (upage, kpage, writable)) 
   {
@@ -241,49 +646,49 @@ bool load_frm_exec (struct shadow_elem *s)
        return false; 
   }
 
+  //insert uvaddr in the frame table entry
+  insert_vaddr (kpage, upage); 
+  if (!writable)
+    frame_share_add (kpage, inode, ofs);
+
   // set location variables
   (s->where).loaded = true;
   return true;
 }
 
 //load the page from mmaped file
-bool load_frm_mmap (struct shadow_elem *s)
+bool load_frm_mmap (struct vma *v, struct shadow_elem *s)
 {
         
         // read in variables
-        struct file *file = s->f_mm; 
-        off_t ofs = s->ofs_mm;
+        struct file *file = v->file; 
         uint8_t *upage = (uint8_t *)s->uvaddr;
-        uint32_t read_bytes = s->read_bytes_mm; 
+        off_t ofs = vma_page_ofs (v, upage);
 
-        size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
+        size_t page_read_bytes = vma_page_read_bytes (v, upage);
         size_t page_zero_bytes = PGSIZE - page_read_bytes;
 
-        lock_acquire(&filesys_lock);
-        file_seek (file, ofs);
-        lock_release(&filesys_lock);
         /* Get a frame of memory. */
         uint8_t *kpage = frame_allocator (PAL_USER);
         if (kpage == NULL)
                  return false;      // for swapping
 
         /* Load this page. */
-        lock_acquire(&filesys_lock);
-        if (file_read (file, kpage, page_read_bytes) != (int) page_read_bytes)
+        bool locked = filesys_lock_enter ();
+        if (file_read_at (file, kpage, page_read_bytes, ofs) != (int) page_read_bytes)
         {
             // if not successful in reading, free the frame
+            if (locked)
+              lock_release(&filesys_lock);
             frame_free (kpage);
-            lock_release(&filesys_lock);
             return false; 
         }
-        lock_release(&filesys_lock);
+        if (locked)
+          lock_release(&filesys_lock);
 
         // set the remaining bytes of pages to zero
         memset (kpage + page_read_bytes, 0, page_zero_bytes);
 
-        //insert uvaddr in the element of ftable_list
-        insert_vaddr (kpage, upage); 
-
         /* Add the page to the process's address space. */
         if (!install_page (upage, kpage, true)) 
         {
@@ -293,11 +698,14 @@ bool load_frm_mmap (struct shadow_elem *s)
         }
         // set the location variable
         (s->where).loaded = true;
+
+        // the frame becomes evictable only once it is mapped
+        insert_vaddr (kpage, upage); 
         return true;
 }
 
-// load the page from swap spacw
-bool load_frm_swap (struct shadow_elem *s)
+// reads the page of s back from swap and maps it
+static bool swap_in_page (struct shadow_elem *s)
 {
     /* get a frame of memrory */
     uint8_t *kpage = frame_allocator (PAL_USER);
@@ -307,10 +715,6 @@ bool load_frm_swap (struct shadow_elem *s)
     // read in from swap
     swap_remove (kpage, s->sec_no);
 
-    // insert vaddr corresponding to the kpage in
-    // frame table    
-    insert_vaddr (kpage, s->uvaddr);
-
     // install the page
     if (!install_page (s->uvaddr, kpage, true)) 
     {
@@ -319,11 +723,43 @@ bool load_frm_swap (struct shadow_elem *s)
       return false; 
     }
 
+    // the only copy of the page is now in memory, so it must
+    // not be dropped as clean if it is evicted again
+    pagedir_set_dirty (thread_current ()->pagedir, s->uvaddr, true);
+
     // set the location variable
     (s->where).swap = false;
+
+    // insert vaddr corresponding to the kpage in frame table;
+    // only a mapped frame may be chosen for eviction
+    insert_vaddr (kpage, s->uvaddr);
     return true;
 }
 
+// load the page from swap spacw
+// swap-out writes neighbouring pages to consecutive slots, so the
+// pages following s are read along while their slots follow s's slot
+// and free frames are plentiful; it costs no extra seek
+bool load_frm_swap (struct shadow_elem *s)
+{
+  struct thread *t = thread_current ();
+  block_sector_t sec = s->sec_no;
+  int i;
+
+  if (!swap_in_page (s))
+    return false;
+
+  for (i = 1; i <= SWAP_READAHEAD; i++)
+  {
+    struct shadow_elem *n = shadow_pg_tbl_lookup (&t->shadow_pg_tbl,
+                                                  s->uvaddr + i * PGSIZE);
+    if (n == NULL || !(n->where).swap || n->sec_no != sec + i * SEC_PER_PG
+        || !reclaim_headroom () || !swap_in_page (n))
+      break;
+  }
+  return true;
+}
+
 /* Adds a mapping from user virtual address UPAGE to kernel
    virtual address KPAGE to the page table.
    If WRITABLE is true, the user process may modify the page;
@@ -344,6 +780,14 @@ install_page (void *upage, void *kpage, bool writable)
           && pagedir_set_page (t->pagedir, upage, kpage, writable));
 }
 
+// lowest address the stack of t may grow down to; the STACK_GUARD
+// pages below it are never mapped, so that running off the stack
+// faults instead of landing in a mapping
+static uint8_t *stack_bottom (struct thread *t)
+{
+  return (uint8_t *) PHYS_BASE - t->stack_limit;
+}
+
 // heuristic to check whether it is a valid stack access
 //--------?? make sure for the kernal faulting addrss ==
 // need not do this, address is verified before accessing
@@ -351,32 +795,364 @@ bool is_valid_stack_access (void *addr, void *esp)
 {
   bool valid = false;
   // 1. check that esp is within 32 bytes of faulting address
-  // 2. checks that stack size dont grow above maximum size
-  if ( ( addr >= (esp - 32) ) && (PHYS_BASE - pg_round_down (addr)) <= STACK_SIZE_MAX )
+  // 2. checks that stack size dont grow above the process's limit
+  if ( ( addr >= (esp - 32) )
+       && pg_round_down (addr) >= (void *) stack_bottom (thread_current ()) )
     valid = true;
 
   return valid;
 }
 
-// grow user's stack, address
-// validity is verified earlier
-bool grow_stack (void *addr)
+// sets the stack limit of the current process to limit bytes,
+// rounded up to whole pages. Pages already mapped below a lowered
+// limit stay mapped.
+// returns 0, or -1 if limit is out of range or the stack and its
+// guard would overlap a program segment or mmap
+int page_set_stack_limit (size_t limit)
+{
+  struct thread *t = thread_current ();
+  uint8_t *bottom;
+
+  if (limit == 0 || limit > STACK_LIMIT_MAX)
+    return -1;
+  bottom = (uint8_t *) PHYS_BASE - ROUND_UP (limit, PGSIZE);
+  if (vma_overlaps (bottom - STACK_GUARD * PGSIZE, PHYS_BASE))
+    return -1;
+  t->stack_limit = ROUND_UP (limit, PGSIZE);
+  return 0;
+}
+
+// drops the current process's page at upage, as if it had never
+// been touched: a changed mmap page is written back to its file,
+// the frame and any swap slot are freed, and the next access reads
+// the page from its file again or sees zeros. Pages shared with
+// other processes are left alone, unless unshare is set: then only
+// this process's mapping of them goes
+static void page_discard (void *upage, bool unshare)
+{
+  struct thread *t = thread_current ();
+  struct shadow_elem *s;
+  void *kpage;
+  bool resident = false;
+  bool locked;
+
+  // 4 MB pages stay until exit, or until page_sbrk() drops them
+  if (pagedir_is_large (t->pagedir, upage))
+    return;
+
+  // a page being evicted or cleaned is waited for, as at munmap
+  locked = filesys_lock_enter ();
+  if (unshare)
+    frame_unshare (upage);
+  while ((kpage = pagedir_get_page (t->pagedir, upage)) != NULL
+         && kpage != zero_page
+         && (unshare || pagedir_is_writable (t->pagedir, upage))
+         && !frame_claim (kpage))
+  {
+    if (locked)
+      lock_release (&filesys_lock);
+    thread_yield ();
+    locked = filesys_lock_enter ();
+  }
+  s = shadow_pg_tbl_lookup (&t->shadow_pg_tbl, upage);
+  if (kpage == zero_page)
+    pagedir_clear_page (t->pagedir, upage);
+  else if (kpage != NULL)
+  {
+    struct vma *v = vma_lookup (t, upage);
+
+    if (!unshare && !pagedir_is_writable (t->pagedir, upage))
+    {
+      if (locked)
+        lock_release (&filesys_lock);
+      return;
+    }
+    if (v != NULL && v->mmap && pagedir_is_dirty (t->pagedir, upage))
+      file_write_at (v->file, kpage, vma_page_read_bytes (v, upage),
+                     vma_page_ofs (v, upage));
+    pagedir_clear_page (t->pagedir, upage);
+    frame_free (kpage);
+    resident = true;
+  }
+  if (locked)
+    lock_release (&filesys_lock);
+
+  if (s == NULL)
+  {
+    // a stack page
+    if (resident)
+      install_page (upage, zero_page, false);
+    return;
+  }
+  if ((s->where).swap)
+    swap_free (s);
+  // a page of a vma is read from its file again; an anonymous
+  // page reads as zeros from now on
+  if (!(s->where).ex && !(s->where).mmap)
+    install_page (upage, zero_page, false);
+  page_entry_delete (s);
+}
+
+// remembers hint advice for the vmas of the current process in the
+// pages [start, end), splitting the vmas that straddle either end
+// returns false if out of memory
+static bool vma_advise (uint8_t *start, uint8_t *end, int advice)
+{
+  struct list *vmas = &thread_current ()->vma_list;
+  struct list_elem *e;
+
+  for (e = list_begin (vmas); e != list_end (vmas); e = list_next (e))
+  {
+    struct vma *v = list_entry (e, struct vma, elem);
+
+    if (v->start >= end)
+      break;
+    if (v->end <= start)
+      continue;
+    if (v->start < start && (v = vma_split (v, start)) == NULL)
+      return false;
+    if (v->end > end && vma_split (v, end) == NULL)
+      return false;
+    v->advice = advice;
+    e = &v->elem;
+  }
+  return true;
+}
+
+// maps every 4 MB aligned stretch of the pages [start, end) of the
+// current process that lies in one writable zero-filled vma and was
+// never touched with a single 4 MB page, while the user pool has
+// aligned runs of free frames and taking one still leaves free
+// frames above the reclaimer's high watermark. Such a page stays
+// until exit, or until the break is lowered below it: it is not in
+// the frame table, so it is never evicted
+static void page_make_large (uint8_t *start, uint8_t *end)
+{
+  struct thread *t = thread_current ();
+  uint8_t *chunk;
+
+  for (chunk = (uint8_t *) ROUND_UP ((uintptr_t) start, LARGE_PGSIZE);
+       chunk < end && (size_t) (end - chunk) >= LARGE_PGSIZE;
+       chunk += LARGE_PGSIZE)
+  {
+    struct vma *v = vma_lookup (t, chunk);
+    uint8_t *upage;
+    void *kpage;
+
+    if (v == NULL || v->mmap || !v->writable
+        || v->end - chunk < LARGE_PGSIZE || vma_page_read_bytes (v, chunk) != 0)
+      continue;
+    for (upage = chunk; upage < chunk + LARGE_PGSIZE; upage += PGSIZE)
+      if (shadow_pg_tbl_lookup (&t->shadow_pg_tbl, upage) != NULL)
+        break;
+    if (upage < chunk + LARGE_PGSIZE)
+      continue;
+
+    if (!reclaim_headroom_for (LARGE_PG_CNT))
+      return;
+    kpage = palloc_get_aligned (PAL_USER | PAL_ZERO, LARGE_PG_CNT);
+    if (kpage == NULL)
+      return;
+    if (!pagedir_set_large_page (t->pagedir, chunk, kpage, true))
+      palloc_free_multiple (kpage, LARGE_PG_CNT);
+  }
+}
+
+// applies hint advice to the len bytes of the current process's
+// pages from page-aligned addr: NORMAL, RANDOM and SEQUENTIAL are
+// remembered for the vmas there, WILLNEED reads the pages in while
+// free frames are plentiful, DONTNEED drops them, and HUGEPAGE
+// maps what it can with 4 MB pages, as long as each one leaves
+// free frames above the reclaimer's high watermark, since such
+// pages are never evicted.
+// returns 0, or -1 if the range or the hint is invalid
+int page_madvise (void *addr, size_t len, int advice)
+{
+  struct thread *t = thread_current ();
+  uint8_t *end = (uint8_t *) addr + ROUND_UP (len, PGSIZE);
+  uint8_t *upage;
+
+  if (pg_ofs (addr) != 0 || !is_user_vaddr (addr)
+      || (size_t) ((uint8_t *) PHYS_BASE - (uint8_t *) addr) < len
+      || advice < MADV_NORMAL || advice > MADV_HUGEPAGE)
+    return -1;
+  if (advice == MADV_HUGEPAGE)
+  {
+    page_make_large (addr, end);
+    return 0;
+  }
+  if (advice != MADV_WILLNEED && advice != MADV_DONTNEED)
+    return vma_advise (addr, end, advice) ? 0 : -1;
+
+  if (advice == MADV_DONTNEED)
+  {
+    pagedir_batch_begin ();
+    for (upage = addr; upage < end; upage += PGSIZE)
+      page_discard (upage, false);
+    pagedir_batch_end ();
+    return 0;
+  }
+  for (upage = addr; upage < end; upage += PGSIZE)
+  {
+    struct shadow_elem *s;
+
+    if (pagedir_get_page (t->pagedir, upage) == NULL
+        && (s = page_lookup (upage)) != NULL)
+    {
+      if (!reclaim_headroom ())
+        break;
+      demand_page (s);
+    }
+  }
+  return 0;
+}
+
+// moves the break of the current process by increment bytes. The
+// heap is a vma without a file and with nothing to read, so its pages
+// map the zero page until written and then go to swap like stack
+// pages. Pages wholly above a lowered break are dropped as with
+// MADV_DONTNEED, except that pages shared with a forked process are
+// only unmapped here, and are no longer part of the address space
+// afterwards; so are 4 MB pages wholly above it.
+// returns the old break, or (void *) -1 if the break would fall below
+// the start of the heap, into a 4 MB page, or the heap would run into
+// another mapping or the stack's guard, or if out of memory
+void *page_sbrk (intptr_t increment)
+{
+  struct thread *t = thread_current ();
+  uint8_t *old = t->heap_end;
+  uint8_t *new = old + increment;
+  uint8_t *old_top = (uint8_t *) ROUND_UP ((uintptr_t) old, PGSIZE);
+  uint8_t *new_top = (uint8_t *) ROUND_UP ((uintptr_t) new, PGSIZE);
+  uint8_t *upage;
+
+  if (t->heap_start == NULL || (increment > 0 ? new < old : new > old)
+      || new < t->heap_start)
+    return (void *) -1;
+
+  if (new_top > old_top)
+  {
+    struct vma *v = old_top > t->heap_start
+                    ? vma_lookup (t, old_top - PGSIZE) : NULL;
+
+    if (new_top > stack_bottom (t) - STACK_GUARD * PGSIZE
+        || vma_overlaps (old_top, new_top))
+      return (void *) -1;
+    for (upage = old_top; upage < new_top; upage += PGSIZE)
+      if (pagedir_get_page (t->pagedir, upage) != NULL
+          || shadow_pg_tbl_lookup (&t->shadow_pg_tbl, upage) != NULL)
+        return (void *) -1;
+
+    // grow the heap's last vma rather than add one per call
+    if (v != NULL && v->file == NULL && !v->mmap && v->end == old_top)
+    {
+      enum intr_level old_level = intr_disable ();
+      v->end = new_top;
+      intr_set_level (old_level);
+    }
+    else if (!vma_create (NULL, 0, old_top, 0, new_top - old_top, true,
+                          false))
+      return (void *) -1;
+  }
+  else if (new_top < old_top)
+  {
+    struct list_elem *e;
+
+    // a 4 MB page is dropped whole or not at all
+    upage = (uint8_t *) ROUND_DOWN ((uintptr_t) new_top, LARGE_PGSIZE);
+    if (upage < new_top && pagedir_is_large (t->pagedir, upage))
+      return (void *) -1;
+    for (; upage < old_top; upage += LARGE_PGSIZE)
+      if (upage >= new_top && pagedir_is_large (t->pagedir, upage))
+        palloc_free_multiple (pagedir_clear_large_page (t->pagedir, upage),
+                              LARGE_PG_CNT);
+
+    pagedir_batch_begin ();
+    for (upage = new_top; upage < old_top; upage += PGSIZE)
+      page_discard (upage, true);
+    pagedir_batch_end ();
+
+    // madvise() may have split the heap into several vmas
+    for (e = list_begin (&t->vma_list); e != list_end (&t->vma_list);
+         e = list_next (e))
+    {
+      struct vma *v = list_entry (e, struct vma, elem);
+      enum intr_level old_level;
+
+      if (v->start >= new_top)
+        break;
+      if (v->end > new_top)
+      {
+        old_level = intr_disable ();
+        v->end = new_top;
+        intr_set_level (old_level);
+      }
+    }
+    vma_remove (new_top, old_top);
+  }
+  t->heap_end = new;
+  return old;
+}
+
+// maps a fresh zeroed stack page at upage
+static bool stack_map_page (uint8_t *upage)
 {
   /* get in physical frame */
-  uint8_t *stk_pg = frame_allocator (PAL_USER);
+  uint8_t *stk_pg = frame_allocator (PAL_USER | PAL_ZERO);
 
   if (stk_pg == NULL)
      return false;
-  insert_vaddr (stk_pg, pg_round_down( addr));
 
   // installing the page
-  if (!install_page (pg_round_down(addr), stk_pg, true)) 
+  if (!install_page (upage, stk_pg, true)) 
   {
     // if not successful in installing, free the frame
     frame_free (stk_pg);
     return false; 
   }
+  // the frame becomes evictable only once it is mapped
+  insert_vaddr (stk_pg, upage);
+  return true;
+}
 
-  return true;  
+// true if upage may be mapped as a new stack page: it lies within
+// the stack limit and nothing is, or was, mapped there
+static bool stack_page_free (struct thread *t, uint8_t *upage)
+{
+  return upage >= stack_bottom (t) && upage < (uint8_t *) PHYS_BASE
+         && pagedir_get_page (t->pagedir, upage) == NULL
+         && vma_lookup (t, upage) == NULL
+         && shadow_pg_tbl_lookup (&t->shadow_pg_tbl, upage) == NULL;
+}
+
+// grow user's stack, address
+// validity is verified earlier; a read maps
+// the shared zero page until the first write.
+// a write also maps up to STACK_PREFETCH pages below, where the
+// stack grows next, and as many unused pages above, which a large
+// frame pushed at once leaves behind; so a deep recursion faults
+// once per several pages. Prefetching stops when free frames run
+// low, so that it never causes eviction
+bool grow_stack (void *addr, bool write)
+{
+  struct thread *t = thread_current ();
+  uint8_t *upage = pg_round_down (addr);
+  uint8_t *p;
+  int i;
+
+  if (!write)
+    return install_page (upage, zero_page, false);
+  if (!stack_map_page (upage))
+    return false;
+
+  for (i = 0, p = upage - PGSIZE; i < STACK_PREFETCH; i++, p -= PGSIZE)
+    if (palloc_user_free_cnt () <= STACK_PREFETCH
+        || !stack_page_free (t, p) || !stack_map_page (p))
+      break;
+  for (i = 0, p = upage + PGSIZE; i < STACK_PREFETCH; i++, p += PGSIZE)
+    if (palloc_user_free_cnt () <= STACK_PREFETCH
+        || !stack_page_free (t, p) || !stack_map_page (p))
+      break;
+  return true;
 }
 
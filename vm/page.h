@@ -4,13 +4,17 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include <hash.h>
+#include <list.h>
 #include <debug.h>
+#include <madvise.h>
 #include "devices/block.h"
 #include "filesys/file.h"
 
-#define STACK_SIZE_MAX  (1 << 23)	// 8MB
-#define NOT_APP_PTR NULL
-#define NOT_APP_INT -1 
+#define STACK_LIMIT_DEFAULT (1 << 23)	// 8MB, stack limit of a new process
+#define STACK_LIMIT_MAX (1 << 26)	// 64MB, largest settable stack limit
+#define STACK_GUARD 16			// pages below the stack limit kept unmapped
+#define STACK_PREFETCH 4		// pages mapped ahead on a stack write fault
+#define FAULT_AROUND 8			// pages mapped ahead on a file fault
 
 // defines where the page is located currently
 struct placed
@@ -22,24 +26,31 @@ struct placed
 };
 
 
+// a virtual memory area: the pages [start, end) of one program
+// segment or mmapped file, in the order of the file. Bytes past the
+// first read_bytes of the area read as zeros
+struct vma
+{
+	uint8_t *start;		// first page of the area
+	uint8_t *end;		// end of the last page
+	struct file *file;	// file the pages are read from
+	off_t ofs;		// offset of start in file
+	off_t read_bytes;	// bytes read from file from start on
+	bool writable;		// whether the pages are writable
+	bool mmap;		// mmapped file, else program segment
+	uint8_t advice;		// MADV_* hint given with madvise()
+	struct list_elem elem;	// in the process's vma_list, by start
+};
+
 // shadow entry corresponding to the page
-// together they will constitute the shadow page table
+// together they will constitute the shadow page table. Pages of a
+// vma get an entry when they are first brought in, other (stack and
+// copied) pages when they are first swapped out
 struct shadow_elem
 {
 	void *uvaddr;		// user virtual address
 	struct placed where;    // current location of page
 	bool writable;		// whether the page is writable
-	
-	//variables used for executables
-	struct file *f_ex;
-	off_t ofs_ex;
-	uint32_t read_bytes_ex;
-	uint32_t zero_bytes_ex;
-	
-	//variables for mmaped files
-	struct file *f_mm;
-	off_t ofs_mm;
-	uint32_t read_bytes_mm;
 
 	//variables for swapping space
 	block_sector_t sec_no;	//sector number of the swap slot
@@ -61,21 +72,38 @@ struct map_elem
 unsigned shadow_hash (const struct hash_elem *p_, void *aux UNUSED);
 bool shadow_less (const struct hash_elem *a_, const struct hash_elem *b_,
            void *aux UNUSED);
-bool create_shadow_entry_exec (struct file *file, off_t ofs, uint8_t *upage, 
-		      	uint32_t read_bytes, uint32_t zero_bytes, bool writable);
+struct thread;
+
 struct shadow_elem *shadow_pg_tbl_lookup (struct hash *ht, void *uvaddr);
-void demand_page (struct shadow_elem *s);
-bool load_frm_exec (struct shadow_elem *s);
+struct shadow_elem *page_lookup (void *upage);
+bool demand_page (struct shadow_elem *s);
+bool load_frm_exec (struct vma *v, struct shadow_elem *s);
 bool is_valid_stack_access (void *addr, void *esp);
-bool grow_stack (void *addr);
+bool grow_stack (void *addr, bool write);
+int page_set_stack_limit (size_t limit);
+void *page_sbrk (intptr_t increment);
 
 unsigned map_hash (const struct hash_elem *p_, void *aux UNUSED);
 bool map_less (const struct hash_elem *a_, const struct hash_elem *b_,void *aux UNUSED);
 struct map_elem *map_table_lookup (struct hash *ht, int mapid);
-bool create_shadow_entry_mmap (struct file *file, off_t ofs, uint8_t *upage, uint32_t read_bytes);
-bool load_frm_mmap (struct shadow_elem *s);
+bool load_frm_mmap (struct vma *v, struct shadow_elem *s);
 bool load_frm_swap (struct shadow_elem *s);
 void shadow_destructor (struct hash_elem *he, void *aux UNUSED);
+bool shadow_pg_tbl_dup (struct hash *dst, struct hash *src, uint32_t *src_pd);
 void map_destructor (struct hash_elem *he, void *aux UNUSED);
+bool mmap_range_free (void *addr, off_t size);
+int mmap_create (struct file *file, void *addr, off_t size);
+void mmap_unmap (struct map_elem *m);
+bool filesys_lock_enter (void);
+int page_madvise (void *addr, size_t len, int advice);
+
+bool vma_create (struct file *file, off_t ofs, void *upage, off_t read_bytes,
+                 size_t size, bool writable, bool mmap);
+struct vma *vma_lookup (struct thread *t, const void *upage);
+off_t vma_page_ofs (const struct vma *v, const void *upage);
+size_t vma_page_read_bytes (const struct vma *v, const void *upage);
+void vma_remove (void *start, void *end);
+bool vma_dup (struct list *dst, struct list *src, struct file *exe);
+void vma_destroy (struct list *vmas);
 
 #endif
@@ -1,3 +1,4 @@
+#include <round.h>
 #include <stdio.h>
 #include "userprog/pagedir.h"
 #include "threads/vaddr.h"
@@ -7,7 +8,55 @@
 #include "userprog/pagedir.h"
 #include "userprog/process.h"
 #include "threads/interrupt.h"
+#include "threads/palloc.h"
+#include "devices/timer.h"
 #include "swap.h"
+#include "zswap.h"
+
+bool swap_wsclock;
+
+// WSClock: a page idle for WS_TAU ticks has left its process's
+// working set; old dirty pages are queued for the reclaimer to clean
+// (write to swap while they stay mapped), up to CLEAN_QUEUE at a time
+#define WS_TAU (TIMER_FREQ / 2)
+#define CLEAN_QUEUE 16
+static size_t clean_queue[CLEAN_QUEUE];	// frame table indices
+static size_t clean_cnt;		// under ftable_lock
+
+// the reclaimer keeps the number of free user frames between the low
+// and high watermarks, so that a fault under memory pressure finds a
+// free frame instead of waiting for an eviction to finish
+static size_t reclaim_low, reclaim_high;
+static struct lock reclaim_lock;
+static struct condition reclaim_cond;
+
+// swap slots are handed out in clusters of SWAP_CLUSTER slots. Each
+// process that swaps has a cursor into a cluster of its own, so its
+// pages land next to each other on disk and are read back in one
+// sequential run. cluster_free counts the free slots of each
+// cluster, so that a free cluster is found without scanning the
+// bitmap. All under swap_lock
+#define SWAP_CLUSTER 32
+#define SWAP_CURSORS 16
+struct swap_cursor
+{
+	tid_t tid;		// owning process, TID_ERROR if unused
+	size_t slot;		// next slot to hand out, BITMAP_ERROR if none
+	unsigned last_use;	// value of cursor_clock at last use
+};
+static struct swap_cursor cursors[SWAP_CURSORS];
+static unsigned cursor_clock;
+static uint8_t *cluster_free;	// free slots in each cluster
+static size_t cluster_cnt;	// number of clusters
+static size_t cluster_hint;	// where to look for a free cluster next
+
+static void reclaimer (void *);
+static void swap_clean_queued (void);
+static void slot_release (block_sector_t);
+static size_t swap_alloc_run (tid_t, size_t *cnt);
+static size_t cluster_size (size_t);
+static void slot_put (size_t slot);
+static bool frame_to_swap (struct frame *, struct thread *);
 
 //initializes the swap block and table
 void swap_init (void)
@@ -17,22 +66,100 @@ void swap_init (void)
 		PANIC ("can't get swap block");
 
 	int no_page = ( block_size(b) / SEC_PER_PG );
+	size_t i;
 
 	// false if swap is free, true otherwise
 	swap_table = bitmap_create(no_page);
 	lock_init(&swap_lock);
 
+	cluster_cnt = DIV_ROUND_UP (no_page, SWAP_CLUSTER);
+	cluster_free = malloc (cluster_cnt);
+	if (swap_table == NULL || cluster_free == NULL)
+		PANIC ("cannot allocate swap table");
+	for (i = 0; i < cluster_cnt; i++)
+		cluster_free[i] = cluster_size (i);
+	for (i = 0; i < SWAP_CURSORS; i++)
+		cursors[i].tid = TID_ERROR;
+	zswap_init ();
+
+	// watermarks scale with the user pool: 1/32 and 1/16 of it
+	reclaim_low = palloc_user_page_cnt () / 32;
+	if (reclaim_low < 2)
+		reclaim_low = 2;
+	reclaim_high = 2 * reclaim_low;
+	lock_init (&reclaim_lock);
+	cond_init (&reclaim_cond);
+	if (thread_create ("reclaimer", PRI_DEFAULT, reclaimer, NULL) == TID_ERROR)
+		PANIC ("cannot start page reclaimer");
+}
+
+// wakes the reclaimer if free user frames dropped below the
+// low watermark; called after each frame allocation
+void reclaim_wakeup (void)
+{
+	if (palloc_user_free_cnt () >= reclaim_low)
+		return;
+	lock_acquire (&reclaim_lock);
+	cond_signal (&reclaim_cond, &reclaim_lock);
+	lock_release (&reclaim_lock);
 }
 
-//allocates a swap slot
-block_sector_t swap_allocate ( void *kaddr )
+// returns whether free frames are plentiful enough to bring in
+// pages nobody has asked for yet
+bool reclaim_headroom (void)
+{
+	return reclaim_headroom_for (0);
+}
+
+// returns whether page_cnt frames can be taken for good and still
+// leave free frames above the high watermark
+bool reclaim_headroom_for (size_t page_cnt)
+{
+	return palloc_user_free_cnt () > reclaim_high + page_cnt;
+}
+
+// page reclaimer thread: evicts frames until the high watermark of
+// free frames is reached and cleans the pages WSClock queued, then
+// sleeps until woken again. Stops evicting early if swap is full;
+// the faulting thread then evicts on its own.
+static void reclaimer (void *aux UNUSED)
+{
+	lock_acquire (&reclaim_lock);
+	for (;;)
+	{
+		cond_wait (&reclaim_cond, &reclaim_lock);
+		lock_release (&reclaim_lock);
+
+		while (palloc_user_free_cnt () < reclaim_high)
+			if (!eviction ())
+				break;
+		swap_clean_queued ();
+
+		lock_acquire (&reclaim_lock);
+	}
+}
+
+//allocates a swap slot for a page of process owner, in the
+//compressed cache if the page fits there
+block_sector_t swap_allocate ( void *kaddr, tid_t owner )
 {
 	lock_acquire(&swap_lock);
+	block_sector_t sec = zswap_store (kaddr);
+	if (sec != (block_sector_t) -1)
+	{
+		lock_release(&swap_lock);
+		return sec;
+	}
+
 	int i=0;
-	int swap_no = bitmap_scan_and_flip (swap_table,0,1,false);
+	size_t cnt = 1;
+	int swap_no = swap_alloc_run (owner, &cnt);
 
 	if ( swap_no == (int)BITMAP_ERROR )
+	{
+		lock_release(&swap_lock);
 		return -1;
+	}
 
 	
 	for ( i = 0; i < SEC_PER_PG; i++ )
@@ -46,8 +173,16 @@ block_sector_t swap_allocate ( void *kaddr )
 void swap_remove ( void *kaddr, block_sector_t sec_no )
 {
 	lock_acquire(&swap_lock);
+	if (is_zswap_sec (sec_no))
+	{
+		zswap_read (sec_no, kaddr);
+		zswap_free (sec_no);
+		lock_release(&swap_lock);
+		return;
+	}
+
 	int i=0;
-	bitmap_flip (swap_table, sec_no/SEC_PER_PG);
+	slot_put (sec_no/SEC_PER_PG);
 
 	for ( i = 0; i < SEC_PER_PG; i++ )
 		block_read ( b, sec_no+ i, kaddr + i*BLOCK_SECTOR_SIZE );
@@ -55,200 +190,916 @@ void swap_remove ( void *kaddr, block_sector_t sec_no )
         lock_release(&swap_lock);
 }
 
-// will perform eviction of frame and free the frame,
-// so that a frame can then be allocated to the caller process
-bool eviction (void)
+// returns whether frame f was accessed since the clock hand last
+// passed it, clearing the accessed bit in every page directory
+// that maps it
+static bool frame_test_accessed (struct frame *f)
+{
+	bool access = false;
+	struct list_elem *a;
+	struct thread *t;
+
+	if (!frame_is_shared (f))
+	{
+		t = get_thread_by_tid (f->tid);
+		if (t == NULL || t->pagedir == NULL)
+			return false;
+		access = pagedir_is_accessed (t->pagedir, f->uvaddr);
+		pagedir_set_accessed (t->pagedir, f->uvaddr, false);
+		return access;
+	}
+
+	for (a = list_begin (&f->tid_s); a != list_end (&f->tid_s); a = list_next (a))
+	{
+		t = get_thread_by_tid (list_entry (a, struct alias_proc, elem)->tid);
+		if (t == NULL || t->pagedir == NULL)
+			continue;
+		if (pagedir_is_accessed (t->pagedir, f->uvaddr))
+		{
+			access = true;
+			pagedir_set_accessed (t->pagedir, f->uvaddr, false);
+		}
+	}
+	return access;
+}
+
+// creates a shadow entry for an anonymous (stack or copied)
+// page at uvaddr that is about to be written to swap
+static struct shadow_elem *swap_anon_entry (void *uvaddr)
+{
+	struct shadow_elem *s = malloc (sizeof(struct shadow_elem));
+	if (s == NULL)
+		return NULL;
+	s->uvaddr = uvaddr;
+
+	// sets the location variable
+	(s->where).ex = false;
+	(s->where).mmap = false;
+	(s->where).swap = true;
+	(s->where).loaded = false;
+
+	s->writable = true;
+	return s;
+}
+
+// a process mapping a shared frame that is being evicted, and the
+// swap slot reserved for its copy of the page
+struct shared_map
+{
+	tid_t tid;
+	bool to_swap;			// needs a slot of its own
+	struct shadow_elem *anon;	// shadow entry, if it has none yet
+	block_sector_t sec;		// reserved slot, -1 if none
+};
+
+// unmaps shared frame f from every process using it. Shared text and
+// read-only executable pages are read back from the executable on the
+// next fault; copy-on-write pages get a swap slot per process, since
+// each process may go on to change its copy. The slots are reserved
+// before any process loses its mapping, and the page is written to
+// them only after ftable_lock is released; swap_lock stays held until
+// then, so that a fault on the page waits for the write.
+// returns false, leaving f mapped everywhere, if swap is full
+static bool evict_shared (struct frame *f)
+{
+	enum intr_level old_level;
+	struct shared_map *m;
+	struct list_elem *a;
+	uint8_t *kaddr = f->phy_frame;
+	size_t n = 0, i, j;
+	bool success = true;
+
+	lock_acquire (&ftable_lock);
+	m = malloc (list_size (&f->tid_s) * sizeof *m);
+	if (m == NULL)
+	{
+		f->evicting = false;
+		lock_release (&ftable_lock);
+		return false;
+	}
+	for (a = list_begin (&f->tid_s); a != list_end (&f->tid_s); a = list_next (a))
+	{
+		struct shadow_elem *s = NULL;
+		struct thread *t;
+
+		m[n].tid = list_entry (a, struct alias_proc, elem)->tid;
+		m[n].anon = NULL;
+		m[n].sec = -1;
+		old_level = intr_disable ();
+		t = get_thread_by_tid (m[n].tid);
+		if (t != NULL && t->pagedir != NULL)
+			s = shadow_pg_tbl_lookup (&t->shadow_pg_tbl, f->uvaddr);
+		m[n].to_swap = t != NULL && t->pagedir != NULL && f->inode == NULL
+			       && (f->cow || s == NULL || !(s->where).ex);
+		intr_set_level (old_level);
+		if (m[n].to_swap && s == NULL)
+		{
+			m[n].anon = swap_anon_entry (f->uvaddr);
+			if (m[n].anon == NULL)
+				success = false;
+		}
+		n++;
+	}
+
+	// reserve every slot before unmapping anything; the page is
+	// read-only in every process, so the compressed copy can be taken
+	// right away
+	lock_acquire (&swap_lock);
+	for (i = 0; success && i < n; i++)
+	{
+		size_t cnt = 1, slot;
+
+		if (!m[i].to_swap)
+			continue;
+		m[i].sec = zswap_store (kaddr);
+		if (m[i].sec != (block_sector_t) -1)
+			continue;
+		slot = swap_alloc_run (m[i].tid, &cnt);
+		if (slot == BITMAP_ERROR)
+			success = false;
+		else
+			m[i].sec = slot * SEC_PER_PG;
+	}
+	if (!success)
+	{
+		for (i = 0; i < n; i++)
+			if (m[i].sec != (block_sector_t) -1)
+				slot_release (m[i].sec);
+		lock_release (&swap_lock);
+		f->evicting = false;
+		lock_release (&ftable_lock);
+		for (i = 0; i < n; i++)
+			free (m[i].anon);
+		free (m);
+		return false;
+	}
+
+	old_level = intr_disable ();
+	for (i = 0; i < n; i++)
+	{
+		struct shadow_elem *s;
+		struct thread *t = get_thread_by_tid (m[i].tid);
+
+		if (t == NULL || t->pagedir == NULL)
+		{
+			if (m[i].sec != (block_sector_t) -1)
+				slot_release (m[i].sec);
+			m[i].sec = -1;
+			continue;
+		}
+		s = shadow_pg_tbl_lookup (&t->shadow_pg_tbl, f->uvaddr);
+		pagedir_clear_page (t->pagedir, f->uvaddr);
+		if (!m[i].to_swap)
+		{
+			if (s != NULL)
+				(s->where).loaded = false;
+			continue;
+		}
+		if (s == NULL)
+		{
+			s = m[i].anon;
+			m[i].anon = NULL;
+			if (s == NULL || hash_insert (&t->shadow_pg_tbl, &s->elem) != NULL)
+				PANIC ("cannot record evicted page");
+		}
+		s->sec_no = m[i].sec;
+		(s->where).swap = true;
+	}
+	intr_set_level (old_level);
+	frame_share_remove (f);
+	lock_release (&ftable_lock);
+
+	for (i = 0; i < n; i++)
+		if (m[i].sec != (block_sector_t) -1 && !is_zswap_sec (m[i].sec))
+			for (j = 0; j < SEC_PER_PG; j++)
+				block_write (b, m[i].sec + j,
+					     kaddr + j * BLOCK_SECTOR_SIZE);
+	lock_release (&swap_lock);
+
+	for (i = 0; i < n; i++)
+		free (m[i].anon);
+	free (m);
+	return true;
+}
+
+// evicts frame_ev on its own and frees the frame: a shared frame, or
+// a private page that is read back from its file. Pages that need
+// swap go through swap_out_batch
+// returns false, leaving the frame mapped, if swap is full or the
+// page was written to since eviction() looked at it
+static bool evict_frame (struct frame *frame_ev)
 {
-	//returns the frame that needs to be evcited
 	enum intr_level old_level;
-	struct frame *frame_ev = eviction_clock ();	
 	void *kaddr = frame_ev->phy_frame;
-	tid_t tid = frame_ev->tid;
-	
+	struct shadow_elem *s;
+	struct thread *t;
+
+	if (frame_is_shared (frame_ev))
+	{
+		if (!evict_shared (frame_ev))
+			return false;
+		frame_free (kaddr);
+		return true;
+	}
+
 	old_level = intr_disable ();
-	struct thread *t = get_thread_by_tid (tid);
-	struct shadow_elem *s = shadow_pg_tbl_lookup (&t->shadow_pg_tbl, 
-								pg_round_down(frame_ev->uvaddr));
+	t = get_thread_by_tid (frame_ev->tid);
+	// the owner is exiting and releasing its frames itself
+	if (t == NULL || t->pagedir == NULL)
+	{
+		intr_set_level (old_level);
+		return true;
+	}
+	// the next batch writes it to swap
+	if (frame_to_swap (frame_ev, t))
+	{
+		intr_set_level (old_level);
+		lock_acquire (&ftable_lock);
+		frame_ev->evicting = false;
+		lock_release (&ftable_lock);
+		return false;
+	}
+	s = shadow_pg_tbl_lookup (&t->shadow_pg_tbl, pg_round_down (frame_ev->uvaddr));
 
-	// allocate shadow entry (if necessary) and populate
-	// the frame to be evcited lies in the stack
-	
-	if (s == NULL)
+	// if frame to be evicted corresponds to mmap
+	if ((s->where).mmap) 
 	{
-		s = malloc (sizeof(struct shadow_elem));
-		s->uvaddr = frame_ev->uvaddr;
-		
-  		// sets the location variable
-  		(s->where).ex = false;
-  		(s->where).mmap = false;
-  		(s->where).swap = true;
-  		(s->where).loaded = false;
-
-  		s->f_ex = NOT_APP_PTR;;
-		s->ofs_ex = NOT_APP_INT;
-		s->read_bytes_ex = NOT_APP_INT;
-		s->zero_bytes_ex = NOT_APP_INT;
-		s->writable = true;
-
-		s->f_mm = NOT_APP_PTR;
-		s->ofs_mm = NOT_APP_INT;
-		s->read_bytes_mm = NOT_APP_INT;
+		// if the page is dirty write back to the file, from the frame
+		// since the page is unmapped by then. The file system lock is
+		// held from before the page is unmapped, so that a fault on it
+		// reads the file only once it is written back, and munmap()
+		// closes the file only after that
+		struct vma *v;
+		struct file *file = NULL;
+		off_t ofs = 0;
+		size_t bytes = 0;
+		bool dirty, locked;
 
-		pagedir_clear_page (t->pagedir, s->uvaddr);
-		
 		intr_set_level (old_level);
-		block_sector_t sec = swap_allocate (kaddr);
-		
+		locked = filesys_lock_enter ();
 		old_level = intr_disable ();
-		s->sec_no = sec;
-		if ((int)s->sec_no == -1)
-			return false;
-                
-		if( hash_insert (&t->shadow_pg_tbl, &s->elem) != NULL)
-			return false;
+		v = vma_lookup (t, s->uvaddr);
+		if (v != NULL)
+		{
+			file = v->file;
+			ofs = vma_page_ofs (v, s->uvaddr);
+			bytes = vma_page_read_bytes (v, s->uvaddr);
+		}
+		dirty = file != NULL && pagedir_is_dirty (t->pagedir, s->uvaddr);
+		(s->where).loaded = false;
+		(s->where).swap = false;
+		pagedir_clear_page (t->pagedir, s->uvaddr);
 		intr_set_level (old_level);
+
+		if (dirty)
+			file_write_at (file, kaddr, bytes, ofs);
+		if (locked)
+			lock_release (&filesys_lock);
 	}
-	// if frame to be evicted corresponds to mmap
-	else if ((s->where).mmap) 
-	{
-		// finding the kernel address corresponding to user VA
-		uint32_t *x = lookup_page(t->pagedir, s->uvaddr, false);
-		uint32_t y = *(x) & PTE_ADDR;
-		void *kadd = ptov ((uintptr_t)y);
-         
-		// if the page is dirty write back to the file....
-		if((pagedir_is_dirty (t->pagedir, s->uvaddr) || pagedir_is_dirty (t->pagedir, kadd))
-		 									&& (s->writable)) 
-                {
-         	  	(s->where).loaded = false;
-              		(s->where).swap = false;   
-         	  	pagedir_clear_page (t->pagedir, s->uvaddr);
-              		lock_acquire(&filesys_lock);
-              		file_write_at((s->f_mm),s->uvaddr,s->read_bytes_mm,s->ofs_mm);
-                        lock_release(&filesys_lock);
-                    
-                }
-                // esle simply evict it
-         	else
-         	{
-          		(s->where).loaded = false;
-         		(s->where).swap = false;
-          		pagedir_clear_page (t->pagedir, s->uvaddr);	         	
-     		}
-     		intr_set_level (old_level);
-        } 
-        // if the frame to be evicted corresponds to the executable
+	// a clean executable page is read back from the executable
 	else if ((s->where).ex)
 	{
-		// finding the kernel address corresponding to user VA
-		uint32_t *x = lookup_page(t->pagedir, s->uvaddr, false);
-		uint32_t y = *(x) & PTE_ADDR;
-		void *kadd = ptov ((uintptr_t)y);
+		(s->where).loaded = false;
+		(s->where).swap = false;
+		pagedir_clear_page (t->pagedir, s->uvaddr);
+		intr_set_level (old_level);
+	}
+	// frame_to_swap() covers every other page
+	else
+		NOT_REACHED ();
+	// free the corresponding frame
+	frame_free (kaddr);
+	return true;
+}
+
+// returns whether the page in frame f, mapped by t, was written to
+static bool frame_dirty (struct frame *f, struct thread *t)
+{
+	return pagedir_is_dirty (t->pagedir, f->uvaddr)
+	       || pagedir_is_dirty (t->pagedir, f->phy_frame);
+}
+
+// returns whether the cleaner's swap copy of private frame f, mapped
+// by t, still holds its contents. Only the user mapping counts: the
+// kernel writes to a frame through its own mapping before it is
+// mapped, never after
+static bool frame_clean_copy (struct frame *f, struct thread *t)
+{
+	return f->clean_sec != (block_sector_t) -1
+	       && !pagedir_is_dirty (t->pagedir, f->uvaddr);
+}
+
+// returns whether private frame f, mapped by t, has to be written
+// to swap when evicted: stack and copied pages always, writable
+// executable pages once they were changed
+static bool frame_to_swap (struct frame *f, struct thread *t)
+{
+	struct shadow_elem *s;
+
+	if (frame_is_shared (f))
+		return false;
+	s = shadow_pg_tbl_lookup (&t->shadow_pg_tbl, pg_round_down (f->uvaddr));
+	if (s == NULL)
+		return true;
+	if ((s->where).mmap)
+		return false;
+	if ((s->where).ex)
+		return s->writable && frame_dirty (f, t);
+	return true;
+}
+
+// returns the number of slots in cluster c; the last one may be short
+static size_t cluster_size (size_t c)
+{
+	size_t end = (c + 1) * SWAP_CLUSTER;
+
+	if (end > bitmap_size (swap_table))
+		end = bitmap_size (swap_table);
+	return end - c * SWAP_CLUSTER;
+}
+
+// marks the cnt slots from slot used. swap_lock must be held
+static void slot_take (size_t slot, size_t cnt)
+{
+	size_t i;
+
+	bitmap_set_multiple (swap_table, slot, cnt, true);
+	for (i = slot; i < slot + cnt; i++)
+		cluster_free[i / SWAP_CLUSTER]--;
+}
+
+// marks slot free. swap_lock must be held
+static void slot_put (size_t slot)
+{
+	if (bitmap_test (swap_table, slot))
+	{
+		bitmap_reset (swap_table, slot);
+		cluster_free[slot / SWAP_CLUSTER]++;
+	}
+}
+
+// returns the cursor of process tid, taking over the least recently
+// used one if it has none yet. swap_lock must be held
+static struct swap_cursor *cursor_get (tid_t tid)
+{
+	struct swap_cursor *c, *lru = &cursors[0];
+
+	for (c = cursors; c < cursors + SWAP_CURSORS; c++)
+	{
+		if (c->tid == tid)
+			break;
+		if (c->tid == TID_ERROR
+		    || (lru->tid != TID_ERROR && c->last_use < lru->last_use))
+			lru = c;
+	}
+	if (c == cursors + SWAP_CURSORS)
+	{
+		c = lru;
+		c->tid = tid;
+		c->slot = BITMAP_ERROR;
+	}
+	c->last_use = ++cursor_clock;
+	return c;
+}
+
+// returns the first slot of a cluster with no slot in use, or
+// BITMAP_ERROR if there is none. Starts where the last search
+// stopped, so that clusters are used round-robin
+static size_t cluster_find (void)
+{
+	size_t i;
+
+	for (i = 0; i < cluster_cnt; i++)
+	{
+		size_t c = (cluster_hint + i) % cluster_cnt;
 
-		// if the page is dirty move it to the swap space....
-		if((pagedir_is_dirty (t->pagedir, s->uvaddr) || pagedir_is_dirty (t->pagedir, kadd) )
-            										 && (s->writable)) 
+		if (cluster_free[c] == cluster_size (c))
+		{
+			cluster_hint = (c + 1) % cluster_cnt;
+			return c * SWAP_CLUSTER;
+		}
+	}
+	return BITMAP_ERROR;
+}
+
+// returns how many of the up to cnt slots from slot on are free,
+// without leaving slot's cluster
+static size_t run_free (size_t slot, size_t cnt)
+{
+	size_t end = (slot / SWAP_CLUSTER + 1) * SWAP_CLUSTER;
+	size_t n;
+
+	if (end > bitmap_size (swap_table))
+		end = bitmap_size (swap_table);
+	for (n = 0; n < cnt && slot + n < end; n++)
+		if (bitmap_test (swap_table, slot + n))
+			break;
+	return n;
+}
+
+// allocates a run of consecutive swap slots for up to *cnt pages of
+// process tid: next to its previous pages if the slots after them
+// are free, else at the start of a free cluster that becomes the
+// process's, else, with swap fragmented, the longest run of up to
+// *cnt slots found by halving the run until one fits.
+// returns the first slot and shrinks *cnt to the run length, or
+// returns BITMAP_ERROR if swap is full.
+// swap_lock must be held
+static size_t swap_alloc_run (tid_t tid, size_t *cnt)
+{
+	struct swap_cursor *c = cursor_get (tid);
+	size_t slot = BITMAP_ERROR, n = 0;
+
+	if (c->slot != BITMAP_ERROR)
+	{
+		slot = c->slot;
+		n = run_free (slot, *cnt);
+	}
+	if (n == 0)
+	{
+		slot = cluster_find ();
+		if (slot != BITMAP_ERROR)
+			n = run_free (slot, *cnt);
+	}
+	for (; n == 0 && *cnt > 0; *cnt /= 2)
+	{
+		slot = bitmap_scan (swap_table, 0, *cnt, false);
+		if (slot != BITMAP_ERROR)
+			n = *cnt;
+	}
+	if (n == 0)
+		return BITMAP_ERROR;
+
+	slot_take (slot, n);
+	*cnt = n;
+	c->slot = (slot + n) % SWAP_CLUSTER != 0 && slot + n < bitmap_size (swap_table)
+		  ? slot + n : BITMAP_ERROR;
+	return slot;
+}
+
+// points the shadow entry of private frame f at swap sector sec and
+// unmaps the page; *anon is used up if the page had no shadow entry.
+// must be called with interrupts off
+// returns false if the owner is exiting and releasing its frames itself
+static bool swap_publish (struct frame *f, struct shadow_elem **anon,
+			  block_sector_t sec)
+{
+	struct thread *t = get_thread_by_tid (f->tid);
+	struct shadow_elem *s;
+
+	ASSERT (intr_get_level () == INTR_OFF);
+	if (t == NULL || t->pagedir == NULL)
+		return false;
+	s = shadow_pg_tbl_lookup (&t->shadow_pg_tbl, pg_round_down (f->uvaddr));
+	if (s == NULL)
+	{
+		s = *anon;
+		*anon = NULL;
+		hash_insert (&t->shadow_pg_tbl, &s->elem);
+	}
+	s->sec_no = sec;
+	(s->where).swap = true;
+	pagedir_clear_page (t->pagedir, s->uvaddr);
+	return true;
+}
+
+// moves the n private frames in batch out of memory, then frees them.
+// Pages the cleaner copied out and left unchanged need no write.
+// Pages that compress well go to the compressed cache; they are
+// compressed with interrupts off, so their owner cannot change them
+// before they are unmapped. The rest are written to consecutive swap
+// slots, in as few sequential runs as swap fragmentation allows. Each
+// page is unmapped and its shadow entry pointed at its slot before
+// swap_lock is released, so a fault on it waits in swap_remove() for
+// the write to finish.
+// returns false if swap is full before anything was moved out
+static bool swap_out_batch (struct frame **batch, size_t n)
+{
+	struct shadow_elem *anon[EVICT_BATCH];
+	void *kpage[EVICT_BATCH];
+	void *zpage[EVICT_BATCH];
+	enum intr_level old_level;
+	size_t done, i, m, z, cnt, slot;
+
+	// entries for stack pages are allocated up front, since malloc
+	// may sleep
+	for (i = 0; i < n; i++)
+	{
+		kpage[i] = batch[i]->phy_frame;
+		anon[i] = swap_anon_entry (batch[i]->uvaddr);
+		if (anon[i] == NULL)
+			PANIC ("cannot record evicted page");
+	}
+
+	// pages the cleaner already copied to swap, then the compressed
+	// cache; pages that fit in neither are moved to the front of the
+	// batch for the swap device
+	lock_acquire (&swap_lock);
+	for (i = m = z = 0; i < n; i++)
+	{
+		block_sector_t sec = batch[i]->clean_sec;
+		struct thread *t;
+
+		old_level = intr_disable ();
+		if (sec != (block_sector_t) -1)
+		{
+			t = get_thread_by_tid (batch[i]->tid);
+			if (t == NULL || t->pagedir == NULL
+			    || !frame_clean_copy (batch[i], t))
+			{
+				slot_release (sec);
+				sec = -1;
+			}
+			batch[i]->clean_sec = -1;
+		}
+		if (sec == (block_sector_t) -1)
+			sec = zswap_store (kpage[i]);
+		if (sec == (block_sector_t) -1)
 		{
-			(s->where).swap = true;
-			pagedir_clear_page (t->pagedir, s->uvaddr);
-			intr_set_level (old_level);
-			
-			block_sector_t sec = swap_allocate (kaddr);
-		
-		        old_level = intr_disable ();						
-			s->sec_no = sec;
-			if ((int)s->sec_no == -1)
-				return false;
 			intr_set_level (old_level);
+			batch[m] = batch[i];
+			kpage[m] = kpage[i];
+			anon[m++] = anon[i];
+			continue;
 		}
-		// else simply evict it
+		if (swap_publish (batch[i], &anon[i], sec))
+			zpage[z++] = kpage[i];
 		else
+			slot_release (sec);
+		intr_set_level (old_level);
+		free (anon[i]);
+	}
+	lock_release (&swap_lock);
+	for (i = 0; i < z; i++)
+		frame_free (zpage[i]);
+	n = m;
+
+	// one run per owner, so that each process's pages stay together
+	for (done = 0; done < n; done += cnt)
+	{
+		for (cnt = 1; done + cnt < n; cnt++)
+			if (batch[done + cnt]->tid != batch[done]->tid)
+				break;
+		lock_acquire (&swap_lock);
+		slot = swap_alloc_run (batch[done]->tid, &cnt);
+		if (slot == BITMAP_ERROR)
 		{
-			(s->where).loaded = false;
-			(s->where).swap = false;
-			pagedir_clear_page (t->pagedir, s->uvaddr);
-		        intr_set_level (old_level);	
+			lock_release (&swap_lock);
+			// leave the rest mapped, for the clock to try again
+			lock_acquire (&ftable_lock);
+			for (i = done; i < n; i++)
+			{
+				batch[i]->evicting = false;
+				free (anon[i]);
+			}
+			lock_release (&ftable_lock);
+			return done > 0 || z > 0;
+		}
+
+		for (i = 0; i < cnt; i++)
+		{
+			old_level = intr_disable ();
+			if (!swap_publish (batch[done + i], &anon[done + i],
+					   (slot + i) * SEC_PER_PG))
+			{
+				slot_put (slot + i);
+				kpage[done + i] = NULL;
+			}
+			intr_set_level (old_level);
+		}
+
+		// one sequential burst for the whole run
+		for (i = 0; i < cnt; i++)
+		{
+			int j;
+
+			if (kpage[done + i] == NULL)
+				continue;
+			for (j = 0; j < SEC_PER_PG; j++)
+				block_write (b, (slot + i) * SEC_PER_PG + j,
+					     kpage[done + i] + j * BLOCK_SECTOR_SIZE);
+		}
+		lock_release (&swap_lock);
+
+		for (i = 0; i < cnt; i++)
+		{
+			free (anon[done + i]);
+			if (kpage[done + i] != NULL)
+				frame_free (kpage[done + i]);
 		}
 	}
-	// if the frame to be evicted corresponds to the stack page
-	// that has initially been moved to the swap space and then moved
-	// in to the RAM.
-	else if (!(s->where).ex && !(s->where).mmap)
+	return true;
+}
+
+// will perform eviction of up to EVICT_BATCH frames and free them,
+// so that a frame can then be allocated to the caller process.
+// Pages that go to swap are written out together in one batch;
+// clean and shared pages are dropped one by one. The TLB entries of
+// the pages unmapped are invalidated together at the end.
+// returns false if nothing could be evicted
+bool eviction (void)
+{
+	struct frame *batch[EVICT_BATCH];
+	size_t n = 0, i;
+	bool evicted = false;
+
+	pagedir_batch_begin ();
+	for (i = 0; i < EVICT_BATCH; i++)
 	{
-		(s->where).swap = true;
-		pagedir_clear_page (t->pagedir, s->uvaddr);
-		intr_set_level (old_level);
-		
-		block_sector_t sec = swap_allocate (kaddr);
-		
-		old_level = intr_disable ();						
-		s->sec_no = sec;
-		if ((int)s->sec_no == -1)
-			return false;
+		enum intr_level old_level;
+		struct frame *frame_ev = eviction_clock ();
+		struct thread *t;
+		bool to_swap;
+
+		if (frame_ev == NULL)
+			break;
+		old_level = intr_disable ();
+		t = get_thread_by_tid (frame_ev->tid);
+		// a page with a clean swap copy is published to that copy,
+		// even if it could be read back from the executable: the
+		// cleaner cleared its dirty bit
+		to_swap = t != NULL && t->pagedir != NULL
+			  && (frame_ev->clean_sec != (block_sector_t) -1
+			      || frame_to_swap (frame_ev, t));
 		intr_set_level (old_level);
+
+		if (to_swap)
+			batch[n++] = frame_ev;
+		else if (evict_frame (frame_ev))
+			evicted = true;
+	}
+	// order the batch by process and address, so that neighbouring
+	// pages land in consecutive slots and can be read back together
+	for (i = 1; i < n; i++)
+	{
+		struct frame *f = batch[i];
+		size_t j;
+
+		for (j = i; j > 0 && (batch[j - 1]->tid > f->tid
+				      || (batch[j - 1]->tid == f->tid
+					  && batch[j - 1]->uvaddr > f->uvaddr)); j--)
+			batch[j] = batch[j - 1];
+		batch[j] = f;
 	}
-	// should never reach here -- undefined state
+	if (n > 0 && swap_out_batch (batch, n))
+		evicted = true;
+	pagedir_batch_end ();
+	return evicted;
+}
+
+// returns whether evicting frame f needs no write: its page can be
+// read back from the executable or from the cleaner's swap copy, or
+// is backed by an unchanged mmapped file. ftable_lock must be held
+static bool frame_clean (struct frame *f)
+{
+	enum intr_level old_level = intr_disable ();
+	struct thread *t = get_thread_by_tid (f->tid);
+	struct shadow_elem *s;
+	bool clean;
+
+	if (frame_is_shared (f))
+		clean = f->inode != NULL;
+	else if (t == NULL || t->pagedir == NULL)
+		clean = true;
+	else if (f->clean_sec != (block_sector_t) -1)
+		clean = frame_clean_copy (f, t);
 	else
 	{
-		printf("undefine state\n");
+		s = shadow_pg_tbl_lookup (&t->shadow_pg_tbl, pg_round_down (f->uvaddr));
+		clean = s != NULL
+			&& (((s->where).mmap && !pagedir_is_dirty (t->pagedir, f->uvaddr))
+			    || ((s->where).ex && !frame_dirty (f, t)));
+	}
+	intr_set_level (old_level);
+	return clean;
+}
+
+// queues frame f for the cleaner, if it is a private page that would
+// be written to swap and the queue has room. ftable_lock must be held
+// returns whether f was queued
+static bool frame_schedule_clean (struct frame *f)
+{
+	enum intr_level old_level;
+	struct thread *t;
+	bool to_swap;
+
+	if (clean_cnt == CLEAN_QUEUE || frame_is_shared (f))
+		return false;
+	old_level = intr_disable ();
+	t = get_thread_by_tid (f->tid);
+	to_swap = t != NULL && t->pagedir != NULL && frame_to_swap (f, t);
+	intr_set_level (old_level);
+	if (!to_swap)
+		return false;
+
+	f->cleaning = true;
+	clean_queue[clean_cnt++] = f - ftable;
+	lock_acquire (&reclaim_lock);
+	cond_signal (&reclaim_cond, &reclaim_lock);
+	lock_release (&reclaim_lock);
+	return true;
+}
+
+// writes the pages queued by WSClock to swap while they stay mapped,
+// so that they can later be evicted without a write. The dirty bit
+// is cleared before the write: a page written to meanwhile shows up
+// dirty again and its copy is not used.
+static void swap_clean_queued (void)
+{
+	for (;;)
+	{
+		enum intr_level old_level;
+		struct frame *f;
+		struct thread *t;
+		block_sector_t sec;
+		void *kpage;
+
+		lock_acquire (&ftable_lock);
+		if (clean_cnt == 0)
+		{
+			lock_release (&ftable_lock);
+			return;
+		}
+		f = &ftable[clean_queue[--clean_cnt]];
+		kpage = f->phy_frame;
+		if (!f->cleaning || f->evicting || kpage == NULL || frame_is_shared (f))
+		{
+			f->cleaning = false;
+			lock_release (&ftable_lock);
+			continue;
+		}
+		old_level = intr_disable ();
+		t = get_thread_by_tid (f->tid);
+		if (t == NULL || t->pagedir == NULL)
+		{
+			intr_set_level (old_level);
+			f->cleaning = false;
+			lock_release (&ftable_lock);
+			continue;
+		}
+		pagedir_set_dirty (t->pagedir, f->uvaddr, false);
+		intr_set_level (old_level);
+		lock_release (&ftable_lock);
+
+		sec = swap_allocate (kpage, f->tid);
+
+		// keep the copy only if the frame still holds the same page;
+		// without one the page is dirty again, or the last copy
+		// would pass for up to date
+		lock_acquire (&ftable_lock);
+		if (sec != (block_sector_t) -1 && f->phy_frame == kpage && f->cleaning
+		    && !f->evicting && !frame_is_shared (f))
+		{
+			if (f->clean_sec != (block_sector_t) -1)
+				swap_slot_free (f->clean_sec);
+			f->clean_sec = sec;
+		}
+		else
+		{
+			if (sec != (block_sector_t) -1)
+				swap_slot_free (sec);
+			if (f->phy_frame == kpage)
+			{
+				old_level = intr_disable ();
+				t = get_thread_by_tid (f->tid);
+				if (t != NULL && t->pagedir != NULL)
+					pagedir_set_dirty (t->pagedir, f->uvaddr, true);
+				intr_set_level (old_level);
+			}
+		}
+		if (f->phy_frame == kpage)
+			f->cleaning = false;
+		lock_release (&ftable_lock);
 	}
-	// free the corresponding frame
-	frame_free (frame_ev->phy_frame);
-        return true;
+}
+
+// WSClock: like the clock, a page accessed since the hand last passed
+// is given another chance, and its age restarts. An idle page is only
+// taken once it is WS_TAU ticks old, out of its process's working
+// set, and only if evicting it needs no write; old dirty pages are
+// queued for the cleaner and passed over. If a whole sweep finds no
+// such page, the first idle page the hand passed is taken.
+// returns NULL if every frame was accessed or is busy
+static struct frame *eviction_wsclock (void)
+{
+	struct frame *ret, *idle = NULL;
+	int64_t now = timer_ticks ();
+	size_t n;
+
+	lock_acquire (&ftable_lock);
+	for (n = 0; n < ftable_size; n++)
+	{
+		ret = &ftable[ftable_clock];
+		ftable_clock = (ftable_clock + 1) % ftable_size;
+
+		if (ret->phy_frame == NULL || ret->uvaddr == NULL || ret->evicting
+		    || ret->cleaning)
+			continue;
+		if (frame_test_accessed (ret))
+		{
+			ret->last_use = now;
+			continue;
+		}
+		if (now - ret->last_use >= WS_TAU)
+		{
+			if (frame_clean (ret))
+			{
+				idle = ret;
+				break;
+			}
+			if (frame_schedule_clean (ret))
+				continue;
+		}
+		if (idle == NULL)
+			idle = ret;
+	}
+	if (idle != NULL)
+		idle->evicting = true;
+	lock_release (&ftable_lock);
+	return idle;
 }
 
 // implementing the clock algorithm for eviction
 struct frame *eviction_clock (void)
 {
+	struct frame *ret;
+	size_t n;
 
-	struct list_elem *f;
-  	struct frame *ret;
-  	struct thread *t;
- 	ret = NULL;
- 	lock_acquire (&ftable_lock);
-        for (f = &clock_ptr->elem; ; f = list_next (f))
-        {
- 	     // checks for the list tail
- 	     if(!(f != NULL && f->prev != NULL && f->next == NULL))
-             {
-                      ret = list_entry (f, struct frame, elem);
-                      t = get_thread_by_tid (ret->tid);
-                      bool access = pagedir_is_accessed ( t->pagedir, ret->uvaddr);
-           
-                      // if the page has access_bit = 1 then set it to 0
-                      if (access)
-            	      {
-                             pagedir_set_accessed (t->pagedir, ret->uvaddr, false);
-            	      }
-                      // else evict the page
-                      else
-                      {
-              	             // move the clock ptr next to evicting frame
-                             clock_ptr = list_entry(list_next(f), struct frame, elem);
-                             lock_release (&ftable_lock);
-                	     return ret ;  
-                      }
-                      // if reach the list end move to beginning - clock aspect
-                      if (f == list_end (&ftable_list))
-                      {
-        		     f = list_begin (&ftable_list);
-                      }
-              }
-              // if reach the list end move to beginning - clock aspect
-              else
-              {
-                      f=list_begin(&ftable_list);
-              }
-        }
-        // should panic if returns here
-        // meaning cannot find the frame to evict
-        PANIC ("eviction_clcok error");
-        return NULL; //the function should never reach here
+	if (swap_wsclock && (ret = eviction_wsclock ()) != NULL)
+		return ret;
+
+	lock_acquire (&ftable_lock);
+	// two sweeps clear every accessed bit, so a victim turns up by then
+	for (n = 0; n < 2 * ftable_size + 1; n++)
+	{
+		ret = &ftable[ftable_clock];
+		// move the clock hand, wrapping at the table end - clock aspect
+		ftable_clock = (ftable_clock + 1) % ftable_size;
+
+		// skip free entries, frames still being set up
+		// (no user address recorded yet), frames another
+		// thread is already evicting and frames the cleaner
+		// is writing out
+		if (ret->phy_frame == NULL || ret->uvaddr == NULL || ret->evicting
+		    || ret->cleaning)
+			continue;
+		// if the page has access_bit = 1 then set it to 0,
+		// else evict the page
+		if (!frame_test_accessed (ret))
+		{
+			ret->evicting = true;
+			lock_release (&ftable_lock);
+			return ret;
+		}
+	}
+	// every frame is being set up or evicted already
+	lock_release (&ftable_lock);
+	return NULL;
+}
+
+// copies the swap slot at sec_no into a newly allocated slot,
+// for the forked child that is running; returns the new slot, or -1
+// if swap is full
+block_sector_t swap_dup (block_sector_t sec_no)
+{
+	block_sector_t sec;
+	void *buf = palloc_get_page (0);
+	int i;
+
+	if (buf == NULL)
+		return -1;
+	lock_acquire(&swap_lock);
+	if (is_zswap_sec (sec_no))
+		zswap_read (sec_no, buf);
+	else
+		for ( i = 0; i < SEC_PER_PG; i++ )
+			block_read ( b, sec_no + i, buf + i*BLOCK_SECTOR_SIZE );
+	lock_release(&swap_lock);
+
+	sec = swap_allocate (buf, thread_current ()->tid);
+	palloc_free_page (buf);
+	return sec;
 }
 
 // to free the swap space
 void swap_free (struct shadow_elem *s)
 {
-	block_sector_t sec = s->sec_no;
-	bitmap_set (swap_table, sec/SEC_PER_PG, false);
+	swap_slot_free (s->sec_no);
+}
+
+// frees the swap slot at sec
+void swap_slot_free (block_sector_t sec)
+{
+	lock_acquire(&swap_lock);
+	slot_release (sec);
+	lock_release(&swap_lock);
+}
+
+// frees the swap slot at sec; swap_lock must be held
+static void slot_release (block_sector_t sec)
+{
+	if (is_zswap_sec (sec))
+		zswap_free (sec);
+	else
+		slot_put (sec/SEC_PER_PG);
 }
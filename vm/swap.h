@@ -2,6 +2,8 @@
 #define VM_SWAP_H
 
 #define SEC_PER_PG 8
+#define EVICT_BATCH 8		// frames evicted per eviction() call
+#define SWAP_READAHEAD 3	// neighbouring pages read along on swap in
 
 #include <bitmap.h>
 #include "devices/block.h"
@@ -13,12 +15,23 @@ struct block *b;	        // block corresponding to the swap space
 struct bitmap *swap_table;	// bitmap used as swap table
 struct lock swap_lock;          // swap lock
 
+/* If false (default), evict with the second chance clock.
+   If true, use WSClock, which keeps each process's recently used
+   pages and prefers clean victims.
+   Controlled by kernel command-line option "-wsclock". */
+extern bool swap_wsclock;
+
 void swap_init (void);
-block_sector_t swap_allocate ( void *kaddr );
+void reclaim_wakeup (void);
+bool reclaim_headroom (void);
+bool reclaim_headroom_for (size_t page_cnt);
+block_sector_t swap_allocate ( void *kaddr, tid_t owner );
 void swap_remove ( void *kaddr, block_sector_t sec_no );
 bool eviction (void);
 struct frame *eviction_clock (void);
 struct thread *get_thread_by_tid (tid_t tid);
 void swap_free (struct shadow_elem *s);
+void swap_slot_free (block_sector_t sec);
+block_sector_t swap_dup (block_sector_t sec_no);
 
 #endif
@@ -0,0 +1,86 @@
+#include <bitmap.h>
+#include <lz.h>
+#include <round.h>
+#include <string.h>
+#include <debug.h>
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+#include "zswap.h"
+
+// the pool is cut into chunks; a compressed page takes a run of them
+#define CHUNK_SIZE 64
+#define POOL_CHUNKS (ZSWAP_POOL_PAGES * PGSIZE / CHUNK_SIZE)
+
+// where the compressed copy of a page lies in the pool
+struct zswap_slot
+{
+	uint16_t chunk;		// first chunk
+	uint16_t size;		// compressed size in bytes
+};
+
+static uint8_t *pool;			// ZSWAP_POOL_PAGES pages of kernel memory
+static struct bitmap *pool_map;		// chunks in use
+static struct bitmap *slot_map;		// slots in use
+static struct zswap_slot slots[ZSWAP_SLOTS];
+static uint8_t zbuf[ZSWAP_MAX_SIZE];	// compression output, under swap_lock
+
+// allocates the pool; without it every page goes to disk
+void zswap_init (void)
+{
+	pool = palloc_get_multiple (0, ZSWAP_POOL_PAGES);
+	pool_map = bitmap_create (POOL_CHUNKS);
+	slot_map = bitmap_create (ZSWAP_SLOTS);
+	if (pool == NULL || pool_map == NULL || slot_map == NULL)
+		pool = NULL;
+}
+
+// compresses the page at kaddr into the pool; returns the sector
+// number naming it, or -1 if the page compresses badly or the pool
+// is full and it has to go to disk instead. Does not sleep, so it can
+// run with interrupts off.
+block_sector_t zswap_store (const void *kaddr)
+{
+	size_t size, chunk, slot;
+
+	if (pool == NULL)
+		return -1;
+	size = lz_compress (kaddr, PGSIZE, zbuf, sizeof zbuf);
+	if (size == 0)
+		return -1;
+
+	slot = bitmap_scan_and_flip (slot_map, 0, 1, false);
+	if (slot == BITMAP_ERROR)
+		return -1;
+	chunk = bitmap_scan_and_flip (pool_map, 0, DIV_ROUND_UP (size, CHUNK_SIZE),
+				      false);
+	if (chunk == BITMAP_ERROR)
+	{
+		bitmap_reset (slot_map, slot);
+		return -1;
+	}
+
+	memcpy (pool + chunk * CHUNK_SIZE, zbuf, size);
+	slots[slot].chunk = chunk;
+	slots[slot].size = size;
+	return ZSWAP_SEC | slot;
+}
+
+// decompresses the page named by sec into kaddr
+void zswap_read (block_sector_t sec, void *kaddr)
+{
+	struct zswap_slot *z = &slots[sec & ~ZSWAP_SEC];
+
+	if (lz_decompress (pool + z->chunk * CHUNK_SIZE, z->size, kaddr, PGSIZE)
+	    != PGSIZE)
+		PANIC ("corrupt compressed swap page");
+}
+
+// drops the page named by sec from the pool
+void zswap_free (block_sector_t sec)
+{
+	size_t slot = sec & ~ZSWAP_SEC;
+
+	bitmap_set_multiple (pool_map, slots[slot].chunk,
+			     DIV_ROUND_UP (slots[slot].size, CHUNK_SIZE), false);
+	bitmap_reset (slot_map, slot);
+}
@@ -0,0 +1,24 @@
+#ifndef VM_ZSWAP_H
+#define VM_ZSWAP_H
+
+#include <stdbool.h>
+#include "devices/block.h"
+
+// compressed swap cache: pages are compressed into a bounded pool of
+// kernel memory in front of the swap device. A page held here is named
+// by a sector number with ZSWAP_SEC set, which no swap device sector
+// ever has, so shadow entries need not tell the two apart.
+#define ZSWAP_SEC 0x80000000u
+#define is_zswap_sec(SEC) (((SEC) & ZSWAP_SEC) != 0)
+
+#define ZSWAP_POOL_PAGES 32		// kernel pages holding compressed data
+#define ZSWAP_SLOTS 512			// most pages held at once
+#define ZSWAP_MAX_SIZE 3072		// pages compressing worse go to disk
+
+// all of these must be called with swap_lock held
+void zswap_init (void);
+block_sector_t zswap_store (const void *kaddr);
+void zswap_read (block_sector_t sec, void *kaddr);
+void zswap_free (block_sector_t sec);
+
+#endif